@@ -5,7 +5,7 @@ purpose: Simple demo that receives characters from
          the serial port and print them on the screen,
          exit the program by pressing Ctrl-C.
 
-compile with the command: gcc demo_rx.c rs232.c -Wall -Wextra -o test_rx
+compile with the command: gcc demo_rx.c rs232.c -Wall -Wextra -pthread -o test_rx
 
 **************************************************/
 
@@ -30,7 +30,7 @@ int main(int argc, char *argv[])
   int baudrate = 115200;
   const char *mode = "8N1";
   int flags_open = 0;
-  int flags_read = 0;
+  int flags_read = RS232_FLAGS_READSOME;  /* Print data as soon as it arrives. */
   int read_timeout = 500; /* Milliseconds. */
 
   char buf[4096];
@@ -5,7 +5,7 @@ purpose: Simple demo that transmits characters to
          the serial port and print them on the screen,
          exit the program by pressing Ctrl-C.
 
-compile with the command: gcc demo_tx.c rs232.c -Wall -Wextra -o test_tx
+compile with the command: gcc demo_tx.c rs232.c -Wall -Wextra -pthread -o test_tx
 
 **************************************************/
 
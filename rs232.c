@@ -31,19 +31,43 @@
  *                                                   https://www.teuniz.net/RS-232
  */
 
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE 1  /* ppoll */
+#endif
+
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <pthread.h>
 #include "rs232.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if WINDOWS_BUILD == 0
+#include <poll.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <linux/serial.h>
+#if WITH_RS232_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+#endif
+
 #define RS232_PERROR(...)
 #define RS232_FPRINTF(fd, ...)
 #define RS232_FPRINTF_DEBUG(fd, ...)
 
 #if !defined(RS232_ADD_EXPORTS)
 #undef RS232_PERROR
-#define RS232_PERROR(...)             perror(__VA_ARGS__)
+#define RS232_PERROR(...)             do { int errsv = errno; perror(__VA_ARGS__); errno = errsv; } while (0)
 
 #undef  RS232_FPRINTF
 #define RS232_FPRINTF(fd, ...)        fprintf(fd, __VA_ARGS__)
@@ -54,132 +78,176 @@
 #endif
 #endif
 
+/* System calls made by a single read or write, counted for RS232_Stats. May be NULL. */
+typedef struct
+{
+  unsigned polls;             /* poll/ppoll */
+  unsigned syscalls;          /* All of them, polls included. */
+} _RS232_Syscalls;
+
+#define _RS232_COUNT_SYSCALL(count, poll)         \
+  do                                              \
+  {                                               \
+    if ((count) != NULL)                          \
+    {                                             \
+      (count)->syscalls++;                        \
+      if (poll) (count)->polls++;                 \
+    }                                             \
+  } while (0)
+
 #if WINDOWS_BUILD == 0
 
-RS232_FD _RS232_Open(const char *devname, int baudrate, const char *mode, int flags)
+/*
+ * Arbitrary baudrates on Linux: struct termios2 with BOTHER, see ioctl_tty(2).
+ * <asm/termbits.h> clashes with <termios.h>, so the kernel structure is declared here.
+ * Its layout differs on a few architectures which are left out.
+ */
+#if defined(__linux__) && defined(TCGETS2) && !defined(__mips__) && !defined(__sparc__) && !defined(__alpha__) && !defined(__powerpc__)
+#define RS232_HAVE_TERMIOS2 1
+
+#ifndef BOTHER
+#define BOTHER 0010000
+#endif
+
+#ifndef IBSHIFT
+#define IBSHIFT 16
+#endif
+
+struct termios2
+{
+  tcflag_t c_iflag;
+  tcflag_t c_oflag;
+  tcflag_t c_cflag;
+  tcflag_t c_lflag;
+  cc_t c_line;
+  cc_t c_cc[19];
+  speed_t c_ispeed;
+  speed_t c_ospeed;
+};
+
+/* Applies settings and the custom baudrate with a single TCSETS2 (TCSETSW2 if drain is set). */
+static int _RS232_SetCustomBaudrate(int fd, const struct termios *settings, int baudrate, bool drain)
 {
 
-  int cbits = CS8, cpar = 0, ipar = IGNPAR, bstop = 0;
-  int fd, err, status;
+  struct termios2 tio;
 
-  if (devname == NULL)
+  if (ioctl(fd, TCGETS2, &tio) == -1) return -1;
+
+  tio.c_iflag = settings->c_iflag;
+  tio.c_oflag = settings->c_oflag;
+  tio.c_cflag = settings->c_cflag & ~(CBAUD | (CBAUD << IBSHIFT));
+  tio.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+  tio.c_lflag = settings->c_lflag;
+  tio.c_cc[VMIN] = settings->c_cc[VMIN];
+  tio.c_cc[VTIME] = settings->c_cc[VTIME];
+  tio.c_ispeed = baudrate;
+  tio.c_ospeed = baudrate;
+
+  return ioctl(fd, drain ? TCSETSW2 : TCSETS2, &tio);
+}
+#else
+#define RS232_HAVE_TERMIOS2 0
+
+static int _RS232_SetCustomBaudrate(int fd, const struct termios *settings, int baudrate, bool drain)
+{
+
+  (void)fd; (void)settings; (void)baudrate; (void)drain;
+  errno = EINVAL;
+  return -1;
+}
+#endif
+
+static const struct
+{
+  int baudrate;
+  speed_t speed;
+} _RS232_Speeds[] =
+{
+  {      50, B50      },
+  {      75, B75      },
+  {     110, B110     },
+  {     134, B134     },
+  {     150, B150     },
+  {     200, B200     },
+  {     300, B300     },
+  {     600, B600     },
+  {    1200, B1200    },
+  {    1800, B1800    },
+  {    2400, B2400    },
+  {    4800, B4800    },
+  {    9600, B9600    },
+  {   19200, B19200   },
+  {   38400, B38400   },
+  {   57600, B57600   },
+  {  115200, B115200  },
+  {  230400, B230400  },
+  {  460800, B460800  },
+#if defined(__linux__)
+  {  500000, B500000  },
+  {  576000, B576000  },
+  {  921600, B921600  },
+  { 1000000, B1000000 },
+  { 1152000, B1152000 },
+  { 1500000, B1500000 },
+  { 2000000, B2000000 },
+  { 2500000, B2500000 },
+  { 3000000, B3000000 },
+  { 3500000, B3500000 },
+  { 4000000, B4000000 },
+#endif
+};
+
+/* Returns the termios speed for baudrate or B0 if there is none. */
+static speed_t _RS232_Speed(int baudrate)
+{
+
+  for (size_t i = 0; i < sizeof(_RS232_Speeds) / sizeof(_RS232_Speeds[0]); i++)
   {
-    RS232_FPRINTF(stderr, "Illegal device.\n");
-    return RS232_INVALID_FD;
+    if (_RS232_Speeds[i].baudrate == baudrate) return _RS232_Speeds[i].speed;
   }
 
+  return B0;
+}
+
+/* Serial settings parsed from baudrate, mode and flags. */
+typedef struct
+{
+  tcflag_t cflag;
+  tcflag_t iflag;
+  speed_t speed;
+  int baudrate;
+  bool custom_baudrate;
+} _RS232_Config;
+
+static int _RS232_ParseConfig(int baudrate, const char *mode, int flags, _RS232_Config *config)
+{
+
+  int cbits = CS8, cpar = 0, ipar = IGNPAR, bstop = 0;
+
   if (mode == NULL)
   {
     RS232_FPRINTF(stderr, "Invalid mode.\n");
-    return RS232_INVALID_FD;
+    return -1;
   }
 
   if (strlen(mode) != 3)
   {
     RS232_FPRINTF(stderr, "Invalid mode '%s'.\n", mode);
-    return RS232_INVALID_FD;
+    return -1;
   }
 
-  switch (baudrate)
+  config->baudrate = baudrate;
+  config->speed = _RS232_Speed(baudrate);
+  config->custom_baudrate = (config->speed == B0);
+
+  if (config->custom_baudrate && (baudrate <= 0 || !RS232_HAVE_TERMIOS2))
   {
-    case      50 :
-      baudrate = B50;
-      break;
-    case      75 :
-      baudrate = B75;
-      break;
-    case     110 :
-      baudrate = B110;
-      break;
-    case     134 :
-      baudrate = B134;
-      break;
-    case     150 :
-      baudrate = B150;
-      break;
-    case     200 :
-      baudrate = B200;
-      break;
-    case     300 :
-      baudrate = B300;
-      break;
-    case     600 :
-      baudrate = B600;
-      break;
-    case    1200 :
-      baudrate = B1200;
-      break;
-    case    1800 :
-      baudrate = B1800;
-      break;
-    case    2400 :
-      baudrate = B2400;
-      break;
-    case    4800 :
-      baudrate = B4800;
-      break;
-    case    9600 :
-      baudrate = B9600;
-      break;
-    case   19200 :
-      baudrate = B19200;
-      break;
-    case   38400 :
-      baudrate = B38400;
-      break;
-    case   57600 :
-      baudrate = B57600;
-      break;
-    case  115200 :
-      baudrate = B115200;
-      break;
-    case  230400 :
-      baudrate = B230400;
-      break;
-    case  460800 :
-      baudrate = B460800;
-      break;
-#if defined(__linux__)
-    case  500000 :
-      baudrate = B500000;
-      break;
-    case  576000 :
-      baudrate = B576000;
-      break;
-    case  921600 :
-      baudrate = B921600;
-      break;
-    case 1000000 :
-      baudrate = B1000000;
-      break;
-    case 1152000 :
-      baudrate = B1152000;
-      break;
-    case 1500000 :
-      baudrate = B1500000;
-      break;
-    case 2000000 :
-      baudrate = B2000000;
-      break;
-    case 2500000 :
-      baudrate = B2500000;
-      break;
-    case 3000000 :
-      baudrate = B3000000;
-      break;
-    case 3500000 :
-      baudrate = B3500000;
-      break;
-    case 4000000 :
-      baudrate = B4000000;
-      break;
-#endif
-    default      :
-      RS232_FPRINTF(stderr, "Invalid baudrate %d.\n", baudrate);
-      return RS232_INVALID_FD;
-      break;
+    RS232_FPRINTF(stderr, "Invalid baudrate %d.\n", baudrate);
+    return -1;
   }
 
+  if (config->custom_baudrate) config->speed = B38400; /* Placeholder, replaced through termios2. */
+
   switch (mode[0])
   {
     case '8':
@@ -196,7 +264,7 @@ RS232_FD _RS232_Open(const char *devname, int baudrate, const char *mode, int fl
       break;
     default :
       RS232_FPRINTF(stderr, "Invalid number of data-bits '%c'.\n", mode[0]);
-      return RS232_INVALID_FD;
+      return -1;
       break;
   }
 
@@ -222,7 +290,7 @@ RS232_FD _RS232_Open(const char *devname, int baudrate, const char *mode, int fl
       break;
     default :
       RS232_FPRINTF(stderr, "Invalid parity '%c'.\n", mode[1]);
-      return RS232_INVALID_FD;
+      return -1;
       break;
   }
 
@@ -236,10 +304,61 @@ RS232_FD _RS232_Open(const char *devname, int baudrate, const char *mode, int fl
       break;
     default :
       RS232_FPRINTF(stderr, "Invalid number of stop bits '%c'.\n", mode[2]);
-      return RS232_INVALID_FD;
+      return -1;
       break;
   }
 
+  config->cflag = cbits | cpar | bstop | CLOCAL | CREAD;
+  if ((flags & RS232_FLAGS_HWFLOWCTRL) == RS232_FLAGS_HWFLOWCTRL)
+  {
+    config->cflag |= CRTSCTS;
+  }
+  config->iflag = ipar;
+
+  return 0;
+}
+
+/* Applies config on top of port_settings. VMIN and VTIME are taken from port_settings as they are. */
+static int _RS232_ApplyConfig(int fd, const struct termios *port_settings, const _RS232_Config *config, bool drain)
+{
+
+  struct termios new_port_settings = *port_settings;
+
+  new_port_settings.c_cflag = config->cflag;
+  new_port_settings.c_iflag = config->iflag;
+  new_port_settings.c_oflag = 0;
+  new_port_settings.c_lflag = 0;
+
+  cfsetispeed(&new_port_settings, config->speed);
+  cfsetospeed(&new_port_settings, config->speed);
+
+  if (config->custom_baudrate)
+  {
+    return _RS232_SetCustomBaudrate(fd, &new_port_settings, config->baudrate, drain);
+  }
+
+  return tcsetattr(fd, drain ? TCSADRAIN : TCSANOW, &new_port_settings);
+}
+
+RS232_FD _RS232_Open(const char *devname, int baudrate, const char *mode, int flags)
+{
+
+  _RS232_Config config;
+  int fd, err, status;
+
+  if (devname == NULL)
+  {
+    RS232_FPRINTF(stderr, "Illegal device.\n");
+    errno = EINVAL;
+    return RS232_INVALID_FD;
+  }
+
+  if (_RS232_ParseConfig(baudrate, mode, flags, &config) == -1)
+  {
+    errno = EINVAL;
+    return RS232_INVALID_FD;
+  }
+
   /*
    * https://pubs.opengroup.org/onlinepubs/7908799/xsh/termios.h.html
    * https://man7.org/linux/man-pages/man3/termios.3.html
@@ -272,24 +391,13 @@ RS232_FD _RS232_Open(const char *devname, int baudrate, const char *mode, int fl
   }
 
   struct termios new_port_settings = old_port_settings;
-  new_port_settings.c_cflag = cbits | cpar | bstop | CLOCAL | CREAD;
-  if ((flags & RS232_FLAGS_HWFLOWCTRL) == RS232_FLAGS_HWFLOWCTRL)
-  {
-    new_port_settings.c_cflag |= CRTSCTS;
-  }
-  new_port_settings.c_iflag = ipar;
-  new_port_settings.c_oflag = 0;
-  new_port_settings.c_lflag = 0;
   new_port_settings.c_cc[VMIN] = 0;      /* block untill n bytes are received */
   new_port_settings.c_cc[VTIME] = 0;     /* block untill a timer expires (n * 100 mSec.) */
 
-  cfsetispeed(&new_port_settings, baudrate);
-  cfsetospeed(&new_port_settings, baudrate);
-
   bool debian_bug_218131;
 
-  err = tcsetattr(fd, TCSANOW, &new_port_settings);
-  debian_bug_218131 = (err == -1);
+  err = _RS232_ApplyConfig(fd, &new_port_settings, &config, false);
+  debian_bug_218131 = (err == -1 && !config.custom_baudrate);
   if (debian_bug_218131) return fd;
   if (err == -1)
   {
@@ -333,12 +441,43 @@ RS232_FD _RS232_Open(const char *devname, int baudrate, const char *mode, int fl
   return fd;
 }
 
+int RS232_Reconfigure(RS232_FD fd, int baudrate, const char *mode, int flags)
+{
+
+  _RS232_Config config;
+  struct termios port_settings;
+  int status = TIOCM_RTS;
+
+  if (_RS232_ParseConfig(baudrate, mode, flags, &config) == -1) return -1;
+
+  if (tcgetattr(fd, &port_settings) == -1)
+  {
+    RS232_PERROR("Unable to read portsettings ");
+    return -1;
+  }
+
+  if (_RS232_ApplyConfig(fd, &port_settings, &config, (flags & RS232_FLAGS_DRAIN) != 0) == -1)
+  {
+    RS232_PERROR("Unable to adjust portsettings ");
+    return -1;
+  }
+
+  if ((flags & RS232_FLAGS_HWFLOWCTRL) == 0)
+  {
+    /* Turn on RTS as no HW flow control enabled. Fails on ports without modem lines. */
+    ioctl(fd, TIOCMBIS, &status);
+  }
+
+  return 0;
+}
+
 int RS232_Close(RS232_FD fd)
 {
 
   int status, err;
   bool debian_bug_218131;
 
+
   err = ioctl(fd, TIOCMGET, &status);
   debian_bug_218131 = (err == -1);
   if (debian_bug_218131) return close(fd);
@@ -363,87 +502,219 @@ int RS232_Close(RS232_FD fd)
   return close(fd);
 }
 
-static ssize_t _RS232_Read(RS232_FD fd, void *buf, size_t size, int flags, int timeout_msec)
+/*
+ * Waits until fd becomes ready for events or timeout expires. Unlike select, poll has no
+ * FD_SETSIZE limit and its cost doesn't depend on the value of fd.
+ *
+ * https://man7.org/linux/man-pages/man2/poll.2.html
+ *
+ * A NULL timeout blocks until fd becomes ready.
+ *
+ * Returns 1 if ready, 0 on timeout or -1 on error.
+ */
+static int _RS232_Wait(RS232_FD fd, short events, const struct timespec *timeout)
 {
 
-  ssize_t read_bytes = -1;
   int fdcount;
-  fd_set readfds;
-  struct timeval timeout;
-  (void)flags;
-
-  FD_ZERO(&readfds);
-  FD_SET(fd, &readfds);
+  struct pollfd pfd;
 
-  timeout.tv_sec = timeout_msec / 1000;
-  timeout.tv_usec = (timeout_msec % 1000) * 1000;
+  pfd.fd = fd;
+  pfd.events = events;
+  pfd.revents = 0;
 
-  fdcount = select(fd + 1, &readfds, NULL, NULL, &timeout);
+#if defined(__linux__) || defined(__FreeBSD__)
+  fdcount = ppoll(&pfd, 1, timeout, NULL);
+#else
+  fdcount = poll(&pfd, 1, timeout ? timespec_to_msec_ceil(timeout) : -1);
+#endif
 
   if (fdcount == -1)
   {
-    RS232_FPRINTF(stderr, "Error in select: %d.\n", errno);
+    RS232_FPRINTF(stderr, "Error in poll: %d.\n", errno);
+    return -1;
   }
-  else if (fdcount == 0)
+
+  if (fdcount == 0) return 0;
+
+  if (pfd.revents & (POLLERR | POLLNVAL))
   {
-    RS232_FPRINTF_DEBUG(stderr, "No data received within %d milliseconds.\n", timeout_msec);
-    read_bytes = 0;
+    RS232_FPRINTF_DEBUG(stderr, "Error condition on file descriptor %d.\n", fd);
+    return -1;
   }
-  else
+
+  return 1;
+}
+
+/*
+ * RS232_FLAGS_KERNELTIMEOUT: the kernel does the waiting (termios VMIN/VTIME) in a single blocking read().
+ * VMIN/VTIME are derived from size and timeout: VMIN = size without timeout, otherwise VMIN = 0 and
+ * VTIME = the timeout rounded down to 100 ms, so that the deadline holds even on a silent line.
+ * What VTIME can't express, less than 100 ms left, is waited for with ppoll().
+ */
+static ssize_t _RS232_ReadKernel(RS232_FD fd, const RS232_IOVec *iov, int iovcnt, const struct timespec *timeout, _RS232_Syscalls *count)
+{
+
+  struct termios port_settings;
+  struct timespec deadline, remaining;
+  size_t size = 0;
+  ssize_t read_bytes;
+
+  for (int i = 0; i < iovcnt; i++)
+  {
+    size += iov[i].iov_len;
+  }
+
+  if (timeout != NULL) timespec_deadline_usec(&deadline, timespecsub_to_usec(timeout));
+
+  if (tcgetattr(fd, &port_settings) == -1) return -1;
+  _RS232_COUNT_SYSCALL(count, false);
+
+  for (;;)
   {
-    if (FD_ISSET(fd, &readfds))
+    cc_t vmin = (size > 255) ? 255 : (cc_t)size;
+    cc_t vtime = 0;
+
+    if (timeout != NULL)
     {
-      read_bytes = read(fd, buf, size);
-      if (read_bytes < 0)
+      if (!timespec_remaining(&deadline, &remaining)) return 0; /* Time is up. */
+
+      long long msec = timespecsub_to_usec(&remaining) / 1000;
+
+      if (msec < 100)
       {
-        RS232_FPRINTF_DEBUG(stderr, "Can't read data.\n");
+        int ready = _RS232_Wait(fd, POLLIN, &remaining);
+        _RS232_COUNT_SYSCALL(count, true);
+        if (ready <= 0) return ready;
+
+        read_bytes = readv(fd, iov, iovcnt);
+        _RS232_COUNT_SYSCALL(count, false);
+        return read_bytes;
       }
+
+      vmin = 0;
+      vtime = (msec >= 25500) ? 255 : (cc_t)(msec / 100);
     }
-  }
 
-  return read_bytes;
+    if (port_settings.c_cc[VMIN] != vmin || port_settings.c_cc[VTIME] != vtime)
+    {
+      port_settings.c_cc[VMIN] = vmin;
+      port_settings.c_cc[VTIME] = vtime;
+
+      if (tcsetattr(fd, TCSANOW, &port_settings) == -1) return -1;
+      _RS232_COUNT_SYSCALL(count, false);
+    }
+
+    /* VMIN/VTIME are ignored in non-blocking mode, fd is non-blocking again once read() returned. */
+    int fl = fcntl(fd, F_GETFL);
+    _RS232_COUNT_SYSCALL(count, false);
+    if (fl == -1 || fcntl(fd, F_SETFL, fl & ~O_NONBLOCK) == -1) return -1;
+    _RS232_COUNT_SYSCALL(count, false);
+
+    read_bytes = readv(fd, iov, iovcnt);
+    _RS232_COUNT_SYSCALL(count, false);
+    int read_errno = errno;
+
+    fcntl(fd, F_SETFL, fl);
+    _RS232_COUNT_SYSCALL(count, false);
+    errno = read_errno;
+
+    if (read_bytes < 0 && errno == EINTR) read_bytes = 0;
+
+    /* VTIME has expired, whatever is left of the timeout is waited for in the next round. */
+    if (read_bytes != 0 || timeout == NULL) return read_bytes;
+  }
 }
 
-static ssize_t _RS232_Write(RS232_FD fd, const void *buf, size_t size, int flags, int timeout_msec)
+static ssize_t _RS232_Read(RS232_FD fd, void *buf, size_t size, int flags, const struct timespec *timeout, _RS232_Syscalls *count)
 {
 
-  ssize_t written_bytes = -1;
-  int fdcount;
-  fd_set writefds;
-  struct timeval timeout;
-  (void)flags;
+  ssize_t read_bytes = -1;
+  int ready;
 
-  FD_ZERO(&writefds);
-  FD_SET(fd, &writefds);
+  if (flags & RS232_FLAGS_KERNELTIMEOUT)
+  {
+    RS232_IOVec iov = { buf, size };
 
-  timeout.tv_sec = timeout_msec / 1000;
-  timeout.tv_usec = (timeout_msec % 1000) * 1000;
+    return _RS232_ReadKernel(fd, &iov, 1, timeout, count);
+  }
 
-  fdcount = select(fd + 1, NULL, &writefds, NULL, &timeout);
+  ready = _RS232_Wait(fd, POLLIN, timeout);
+  _RS232_COUNT_SYSCALL(count, true);
 
-  if (fdcount == -1)
+  if (ready == 0)
   {
-    RS232_FPRINTF(stderr, "Error in select: %d.\n", errno);
+    RS232_FPRINTF_DEBUG(stderr, "No data received within %ld microseconds.\n", (long)timespecsub_to_usec(timeout));
+    read_bytes = 0;
   }
-  else if (fdcount == 0)
+  else if (ready > 0)
   {
-    RS232_FPRINTF(stderr, "No data sent within %d milliseconds.\n", timeout_msec);
+    read_bytes = read(fd, buf, size);
+    _RS232_COUNT_SYSCALL(count, false);
+    if (read_bytes < 0)
+    {
+      RS232_FPRINTF_DEBUG(stderr, "Can't read data.\n");
+    }
   }
-  else
+
+  return read_bytes;
+}
+
+static ssize_t _RS232_Write(RS232_FD fd, const void *buf, size_t size, int flags, const struct timespec *timeout, _RS232_Syscalls *count)
+{
+
+  ssize_t written_bytes = -1;
+  int ready;
+  (void)flags;
+
+  ready = _RS232_Wait(fd, POLLOUT, timeout);
+  _RS232_COUNT_SYSCALL(count, true);
+
+  if (ready == 0)
   {
-    if (FD_ISSET(fd, &writefds))
+    /* No room for a non-blocking write is nothing to report, see RS232_PortWriteAsync. */
+    if (timespecsub_to_usec(timeout) > 0)
     {
-      written_bytes = write(fd, buf, size);
-      if (written_bytes < 0)
-      {
-        RS232_FPRINTF_DEBUG(stderr, "Can't write data.\n");
-      }
+      RS232_FPRINTF(stderr, "No data sent within %ld microseconds.\n", (long)timespecsub_to_usec(timeout));
+    }
+  }
+  else if (ready > 0)
+  {
+    written_bytes = write(fd, buf, size);
+    _RS232_COUNT_SYSCALL(count, false);
+    if (written_bytes < 0)
+    {
+      RS232_FPRINTF_DEBUG(stderr, "Can't write data.\n");
     }
   }
 
   return written_bytes;
 }
 
+static ssize_t _RS232_Readv(RS232_FD fd, const RS232_IOVec *iov, int iovcnt, int flags, const struct timespec *timeout)
+{
+
+  int ready;
+
+  if (flags & RS232_FLAGS_KERNELTIMEOUT) return _RS232_ReadKernel(fd, iov, iovcnt, timeout, NULL);
+
+  ready = _RS232_Wait(fd, POLLIN, timeout);
+  if (ready <= 0) return ready;
+
+  return readv(fd, iov, iovcnt);
+}
+
+static ssize_t _RS232_Writev(RS232_FD fd, const RS232_IOVec *iov, int iovcnt, int flags, const struct timespec *timeout)
+{
+
+  int ready;
+  (void)flags;
+
+  ready = _RS232_Wait(fd, POLLOUT, timeout);
+  if (ready <= 0) return ready;
+
+  return writev(fd, iov, iovcnt);
+}
+
 /*
 Constant  Description
 TIOCM_LE        DSR (data set ready/line enable)
@@ -461,24 +732,56 @@ TIOCM_DSR       DSR (data set ready)
 https://man7.org/linux/man-pages/man4/tty_ioctl.4.html
 */
 
-int RS232_IsDCDEnabled(RS232_FD fd)
+static int _RS232_LinesFromTIOCM(int status)
 {
 
-  int status;
+  return ((status & TIOCM_DTR) ? RS232_LINE_DTR : 0) |
+         ((status & TIOCM_RTS) ? RS232_LINE_RTS : 0) |
+         ((status & TIOCM_CTS) ? RS232_LINE_CTS : 0) |
+         ((status & TIOCM_DSR) ? RS232_LINE_DSR : 0) |
+         ((status & TIOCM_CAR) ? RS232_LINE_DCD : 0) |
+         ((status & TIOCM_RNG) ? RS232_LINE_RI : 0);
+}
 
-  if (ioctl(fd, TIOCMGET, &status) == -1) return -1;
+static int _RS232_LinesToTIOCM(int lines)
+{
 
-  return (status & TIOCM_CAR) ? 1 : 0;
+  return ((lines & RS232_LINE_DTR) ? TIOCM_DTR : 0) |
+         ((lines & RS232_LINE_RTS) ? TIOCM_RTS : 0) |
+         ((lines & RS232_LINE_CTS) ? TIOCM_CTS : 0) |
+         ((lines & RS232_LINE_DSR) ? TIOCM_DSR : 0) |
+         ((lines & RS232_LINE_DCD) ? TIOCM_CAR : 0) |
+         ((lines & RS232_LINE_RI) ? TIOCM_RNG : 0);
 }
 
-int RS232_IsRINGEnabled(RS232_FD fd)
+int RS232_GetModemLines(RS232_FD fd)
 {
 
   int status;
 
   if (ioctl(fd, TIOCMGET, &status) == -1) return -1;
 
-  return (status & TIOCM_RNG) ? 1 : 0;
+  return _RS232_LinesFromTIOCM(status);
+}
+
+int RS232_IsDCDEnabled(RS232_FD fd)
+{
+
+  int status;
+
+  if (ioctl(fd, TIOCMGET, &status) == -1) return -1;
+
+  return (status & TIOCM_CAR) ? 1 : 0;
+}
+
+int RS232_IsRINGEnabled(RS232_FD fd)
+{
+
+  int status;
+
+  if (ioctl(fd, TIOCMGET, &status) == -1) return -1;
+
+  return (status & TIOCM_RNG) ? 1 : 0;
 }
 
 int RS232_IsCTSEnabled(RS232_FD fd)
@@ -501,59 +804,130 @@ int RS232_IsDSREnabled(RS232_FD fd)
   return (status & TIOCM_DSR) ? 1 : 0;
 }
 
-int RS232_enableDTR(RS232_FD fd)
+int RS232_SetModemLines(RS232_FD fd, int set, int clear)
 {
 
   int status;
 
-  if (ioctl(fd, TIOCMGET, &status) == -1) return -1;
+  if (((set | clear) & ~(RS232_LINE_DTR | RS232_LINE_RTS)) != 0 || (set & clear) != 0) return -1;
 
-  status |= TIOCM_DTR;    /* turn on DTR */
+  status = _RS232_LinesToTIOCM(set);
+  if (status != 0 && ioctl(fd, TIOCMBIS, &status) == -1) return -1;
 
-  if (ioctl(fd, TIOCMSET, &status) == -1) return -1;
+  status = _RS232_LinesToTIOCM(clear);
+  if (status != 0 && ioctl(fd, TIOCMBIC, &status) == -1) return -1;
 
   return 0;
 }
 
+int RS232_SetRS485(RS232_FD fd, const RS232_RS485Config *config)
+{
 
-int RS232_disableDTR(RS232_FD fd)
+#if defined(__linux__) && defined(TIOCSRS485)
+  struct serial_rs485 rs485;
+
+  memset(&rs485, 0, sizeof(rs485));
+
+  if (config != NULL)
+  {
+    if (config->delay_before_send_msec < 0 || config->delay_after_send_msec < 0) return -1;
+
+    rs485.flags = SER_RS485_ENABLED;
+    rs485.flags |= config->rts_on_send ? SER_RS485_RTS_ON_SEND : SER_RS485_RTS_AFTER_SEND;
+    if (config->rx_during_tx) rs485.flags |= SER_RS485_RX_DURING_TX;
+    rs485.delay_rts_before_send = (uint32_t)config->delay_before_send_msec;
+    rs485.delay_rts_after_send = (uint32_t)config->delay_after_send_msec;
+  }
+
+  if (ioctl(fd, TIOCSRS485, &rs485) == -1)
+  {
+    RS232_FPRINTF_DEBUG(stderr, "RS-485 mode is not supported by the driver: %d.\n", errno);
+    return -1;
+  }
+
+  return 0;
+#else
+  (void)fd; (void)config;
+  return -1;
+#endif
+}
+
+/* Reads the modem control register once, the shadow keeps track of it from then on. */
+static int _RS232_ModemShadowInit(RS232_FD fd, int *shadow)
 {
 
-  int status;
+  return ioctl(fd, TIOCMGET, shadow) == -1 ? -1 : 0;
+}
 
-  if (ioctl(fd, TIOCMGET, &status) == -1) return -1;
+/* Changes the output lines with at most one ioctl, none if they are already in the requested state. */
+static int _RS232_ModemShadowApply(RS232_FD fd, int *shadow, int set, int clear)
+{
 
-  status &= ~TIOCM_DTR;    /* turn off DTR */
+  int bis = _RS232_LinesToTIOCM(set) & ~*shadow;
+  int bic = _RS232_LinesToTIOCM(clear) & *shadow;
+  int status = (*shadow | bis) & ~bic;
+
+  if (bis != 0 && bic != 0)
+  {
+    if (ioctl(fd, TIOCMSET, &status) == -1) return -1;   /* Keeps the other bits from the shadow. */
+  }
+  else if (bis != 0)
+  {
+    if (ioctl(fd, TIOCMBIS, &bis) == -1) return -1;
+  }
+  else if (bic != 0)
+  {
+    if (ioctl(fd, TIOCMBIC, &bic) == -1) return -1;
+  }
 
-  if (ioctl(fd, TIOCMSET, &status) == -1) return -1;
+  *shadow = status;
 
   return 0;
 }
 
-int RS232_enableRTS(RS232_FD fd)
+static int _RS232_ModemShadowLines(int shadow)
 {
 
-  int status;
+  return _RS232_LinesFromTIOCM(shadow) & (RS232_LINE_DTR | RS232_LINE_RTS);
+}
 
-  if (ioctl(fd, TIOCMGET, &status) == -1) return -1;
+int RS232_enableDTR(RS232_FD fd)
+{
 
-  status |= TIOCM_RTS;    /* turn on RTS */
+  int status = TIOCM_DTR;
 
-  if (ioctl(fd, TIOCMSET, &status) == -1) return -1;
+  if (ioctl(fd, TIOCMBIS, &status) == -1) return -1;    /* turn on DTR */
 
   return 0;
 }
 
-int RS232_disableRTS(RS232_FD fd)
+
+int RS232_disableDTR(RS232_FD fd)
 {
 
-  int status;
+  int status = TIOCM_DTR;
 
-  if (ioctl(fd, TIOCMGET, &status) == -1) return -1;
+  if (ioctl(fd, TIOCMBIC, &status) == -1) return -1;    /* turn off DTR */
 
-  status &= ~TIOCM_RTS;    /* turn off RTS */
+  return 0;
+}
 
-  if (ioctl(fd, TIOCMSET, &status) == -1) return -1;
+int RS232_enableRTS(RS232_FD fd)
+{
+
+  int status = TIOCM_RTS;
+
+  if (ioctl(fd, TIOCMBIS, &status) == -1) return -1;    /* turn on RTS */
+
+  return 0;
+}
+
+int RS232_disableRTS(RS232_FD fd)
+{
+
+  int status = TIOCM_RTS;
+
+  if (ioctl(fd, TIOCMBIC, &status) == -1) return -1;    /* turn off RTS */
 
   return 0;
 }
@@ -600,133 +974,248 @@ int RS232_flushRXTX(RS232_FD fd)
   return tcflush(fd, TCIOFLUSH);
 }
 
-#else  /* Windows */
+int RS232_BytesAvailable(RS232_FD fd)
+{
 
-RS232_FD _RS232_Open(const char *devname, int baudrate, const char *mode, int flags)
+  int bytes;
+
+  if (ioctl(fd, TIOCINQ, &bytes) == -1)
+  {
+    RS232_PERROR("Unable to get the amount of received bytes ");
+    return -1;
+  }
+
+  return bytes;
+}
+
+int RS232_BytesPending(RS232_FD fd)
 {
 
-  if (devname == NULL)
+  int bytes;
+
+  if (ioctl(fd, TIOCOUTQ, &bytes) == -1)
   {
-    RS232_FPRINTF(stderr, "Illegal device.\n");
-    return RS232_INVALID_FD;
+    RS232_PERROR("Unable to get the amount of bytes to send ");
+    return -1;
   }
 
-  if (mode == NULL)
+  return bytes;
+}
+
+/* Returns 1 if the transmit shift register is empty, 0 if not or -1 if the driver can't tell. */
+static int _RS232_TransmitterEmpty(RS232_FD fd)
+{
+
+#if defined(TIOCSERGETLSR)
+  unsigned int lsr;
+
+  if (ioctl(fd, TIOCSERGETLSR, &lsr) == 0) return (lsr & TIOCSER_TEMT) ? 1 : 0;
+#else
+  (void)fd;
+#endif
+
+  return -1;
+}
+
+/* Waits until the output queue and the transmit shift register are empty. */
+static int _RS232_Drain(RS232_FD fd)
+{
+
+  while (tcdrain(fd) == -1)
   {
-    RS232_FPRINTF(stderr, "Invalid mode.\n");
-    return RS232_INVALID_FD;
+    if (errno != EINTR)
+    {
+      RS232_PERROR("Unable to drain ");
+      return -1;
+    }
   }
 
-  if (strlen(mode) != 3)
+  return 0;
+}
+
+static void _RS232_SleepUsec(long long usec)
+{
+
+  struct timespec ts;
+
+  ts.tv_sec = (time_t)(usec / 1000000LL);
+  ts.tv_nsec = (long)(usec % 1000000LL) * 1000L;
+
+  while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+/* Same as RS232_GetICounter but without error message, for callers probing the driver. */
+static int _RS232_GetICounter(RS232_FD fd, RS232_ICounter *counter)
+{
+
+#if defined(__linux__) && defined(TIOCGICOUNT)
+  struct serial_icounter_struct icount;
+
+  if (ioctl(fd, TIOCGICOUNT, &icount) == -1) return -1;
+
+  counter->rx = (uint32_t)icount.rx;
+  counter->tx = (uint32_t)icount.tx;
+  counter->frame = (uint32_t)icount.frame;
+  counter->overrun = (uint32_t)icount.overrun;
+  counter->parity = (uint32_t)icount.parity;
+  counter->brk = (uint32_t)icount.brk;
+  counter->buf_overrun = (uint32_t)icount.buf_overrun;
+
+  return 0;
+#else
+  (void)fd; (void)counter;
+  errno = ENOTSUP;
+  return -1;
+#endif
+}
+
+int RS232_GetICounter(RS232_FD fd, RS232_ICounter *counter)
+{
+
+  if (counter == NULL) return -1;
+
+  if (_RS232_GetICounter(fd, counter) == -1)
   {
-    RS232_FPRINTF(stderr, "Invalid mode '%s'.\n", mode);
-    return RS232_INVALID_FD;
+    RS232_PERROR("Unable to get interrupt counters ");
+    return -1;
   }
 
-  /*
-   * https://msdn.microsoft.com/en-us/library/windows/desktop/aa363145%28v=vs.85%29.aspx
-   * https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-buildcommdcbandtimeoutsa
-   *
-   * https://technet.microsoft.com/en-us/library/cc732236.aspx
-   * https://docs.microsoft.com/en-us/previous-versions/windows/it-pro/windows-server-2012-R2-and-2012/cc732236(v=ws.11)
-   *
-   * https://docs.microsoft.com/en-us/windows/desktop/api/winbase/ns-winbase-_dcb
-   * https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-buildcommdcba
-   */
+  return 0;
+}
 
-  RS232_FD fd = CreateFileA(devname,
-                            GENERIC_READ | GENERIC_WRITE,
-                            #if WITH_RS232_LOCK
-                            0,                          /* No share: access locked. */
-                            #else
-                            FILE_SHARE_READ | FILE_SHARE_WRITE, /* Share for read and write. */
-                            #endif
-                            NULL,                       /* No security. */
-                            OPEN_EXISTING,
-                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,
-                            NULL);                      /* No templates. */
+int RS232_GetBaudrate(RS232_FD fd)
+{
 
-  if (fd == RS232_INVALID_FD)
+#if RS232_HAVE_TERMIOS2
+  struct termios2 tio;
+
+  /* The driver stores the baudrate it has actually set. */
+  if (ioctl(fd, TCGETS2, &tio) == -1) return -1;
+
+  return (int)tio.c_ospeed;
+#else
+  struct termios port_settings;
+
+  if (tcgetattr(fd, &port_settings) == -1) return -1;
+
+  speed_t speed = cfgetospeed(&port_settings);
+
+  for (size_t i = 0; i < sizeof(_RS232_Speeds) / sizeof(_RS232_Speeds[0]); i++)
   {
-    RS232_FPRINTF(stderr, "Unable to open comport %s.\n", devname);
-    return RS232_INVALID_FD;
+    if (_RS232_Speeds[i].speed == speed) return _RS232_Speeds[i].baudrate;
   }
 
-  DCB port_settings;
+  return -1;
+#endif
+}
 
-  if (!GetCommState(fd, &port_settings))
+int RS232_SetReadTimeouts(RS232_FD fd, size_t min_size, int timeout_msec)
+{
+
+  struct termios port_settings;
+
+  if (timeout_msec < 0) timeout_msec = 0;
+
+  if (tcgetattr(fd, &port_settings) == -1)
   {
-    RS232_FPRINTF(stderr, "Unable to get comport settings.\n");
-    CloseHandle(fd);
-    return RS232_INVALID_FD;
+    RS232_PERROR("Unable to read portsettings ");
+    return -1;
+  }
+
+  port_settings.c_cc[VMIN] = (min_size > 255) ? 255 : (cc_t)min_size;
+  port_settings.c_cc[VTIME] = (timeout_msec > 25500) ? 255 : (cc_t)((timeout_msec + 99) / 100);
+
+  if (tcsetattr(fd, TCSANOW, &port_settings) == -1)
+  {
+    RS232_PERROR("Unable to adjust portsettings ");
+    return -1;
+  }
+
+  return 0;
+}
+
+#else  /* Windows */
+
+/* Sets up port_settings for baudrate, mode and flags. Returns 0 on success or -1 if a parameter is invalid. */
+static int _RS232_SetupDCB(DCB *port_settings, int baudrate, const char *mode, int flags)
+{
+
+  if (mode == NULL)
+  {
+    RS232_FPRINTF(stderr, "Invalid mode.\n");
+    return -1;
+  }
+
+  if (strlen(mode) != 3)
+  {
+    RS232_FPRINTF(stderr, "Invalid mode '%s'.\n", mode);
+    return -1;
   }
 
   switch (baudrate)
   {
     case     110 :
-      port_settings.BaudRate = CBR_110;
+      port_settings->BaudRate = CBR_110;
       break;
     case     300 :
-      port_settings.BaudRate = CBR_300;
+      port_settings->BaudRate = CBR_300;
       break;
     case     600 :
-      port_settings.BaudRate = CBR_600;
+      port_settings->BaudRate = CBR_600;
       break;
     case    1200 :
-      port_settings.BaudRate = CBR_1200;
+      port_settings->BaudRate = CBR_1200;
       break;
     case    2400 :
-      port_settings.BaudRate = CBR_2400;
+      port_settings->BaudRate = CBR_2400;
       break;
     case    4800 :
-      port_settings.BaudRate = CBR_4800;
+      port_settings->BaudRate = CBR_4800;
       break;
     case    9600 :
-      port_settings.BaudRate = CBR_9600;
+      port_settings->BaudRate = CBR_9600;
       break;
     case   19200 :
-      port_settings.BaudRate = CBR_19200;
+      port_settings->BaudRate = CBR_19200;
       break;
     case   38400 :
-      port_settings.BaudRate = CBR_38400;
+      port_settings->BaudRate = CBR_38400;
       break;
     case   57600 :
-      port_settings.BaudRate = CBR_57600;
+      port_settings->BaudRate = CBR_57600;
       break;
     case  115200 :
-      port_settings.BaudRate = CBR_115200;
+      port_settings->BaudRate = CBR_115200;
       break;
     case  128000 :
-      port_settings.BaudRate = CBR_128000;
+      port_settings->BaudRate = CBR_128000;
       break;
     case  256000 :
-      port_settings.BaudRate = CBR_256000;
+      port_settings->BaudRate = CBR_256000;
       break;
     default      :
       RS232_FPRINTF(stderr, "Invalid baudrate.\n");
-      CloseHandle(fd);
-      return RS232_INVALID_FD;
+      return -1;
       break;
   }
 
   switch (mode[0])
   {
     case '8':
-      port_settings.ByteSize = 8;
+      port_settings->ByteSize = 8;
       break;
     case '7':
-      port_settings.ByteSize = 7;
+      port_settings->ByteSize = 7;
       break;
     case '6':
-      port_settings.ByteSize = 6;
+      port_settings->ByteSize = 6;
       break;
     case '5':
-      port_settings.ByteSize = 5;
+      port_settings->ByteSize = 5;
       break;
     default :
       RS232_FPRINTF(stderr, "Invalid number of data-bits '%c'.\n", mode[0]);
-      CloseHandle(fd);
-      return RS232_INVALID_FD;
+      return -1;
       break;
   }
 
@@ -735,95 +1224,178 @@ RS232_FD _RS232_Open(const char *devname, int baudrate, const char *mode, int fl
     case 'N':
       /* FALLTHRU */
     case 'n':
-      port_settings.Parity = NOPARITY;
+      port_settings->Parity = NOPARITY;
       break;
     case 'E':
       /* FALLTHRU */
     case 'e':
-      port_settings.Parity = EVENPARITY;
+      port_settings->Parity = EVENPARITY;
       break;
     case 'O':
       /* FALLTHRU */
     case 'o':
-      port_settings.Parity = ODDPARITY;
+      port_settings->Parity = ODDPARITY;
       break;
     default :
       RS232_FPRINTF(stderr, "Invalid parity '%c'.\n", mode[1]);
-      CloseHandle(fd);
-      return RS232_INVALID_FD;
+      return -1;
       break;
   }
 
   switch (mode[2])
   {
     case '1':
-      port_settings.StopBits = ONESTOPBIT;
+      port_settings->StopBits = ONESTOPBIT;
       break;
     case '2':
-      port_settings.StopBits = TWOSTOPBITS;
+      port_settings->StopBits = TWOSTOPBITS;
       break;
     default :
       RS232_FPRINTF(stderr, "Invalid number of stop bits '%c'.\n", mode[2]);
-      CloseHandle(fd);
-      return RS232_INVALID_FD;
+      return -1;
       break;
   }
 
   if ((flags & RS232_FLAGS_HWFLOWCTRL) == RS232_FLAGS_HWFLOWCTRL)
   {
-    port_settings.fOutxCtsFlow = TRUE;
-    port_settings.fRtsControl = RTS_CONTROL_HANDSHAKE;
+    port_settings->fOutxCtsFlow = TRUE;
+    port_settings->fRtsControl = RTS_CONTROL_HANDSHAKE;
   }
   else
   {
-    port_settings.fOutxCtsFlow = FALSE;
-    port_settings.fRtsControl = RTS_CONTROL_ENABLE;
+    port_settings->fOutxCtsFlow = FALSE;
+    port_settings->fRtsControl = RTS_CONTROL_ENABLE;
   }
 
-  port_settings.fOutxDsrFlow = FALSE;
-  port_settings.fDsrSensitivity = FALSE;
-  port_settings.fDtrControl = DTR_CONTROL_DISABLE;
+  port_settings->fOutxDsrFlow = FALSE;
+  port_settings->fDsrSensitivity = FALSE;
+  port_settings->fDtrControl = DTR_CONTROL_DISABLE;
 
-  if (!SetCommState(fd, &port_settings))
+  return 0;
+}
+
+RS232_FD _RS232_Open(const char *devname, int baudrate, const char *mode, int flags)
+{
+
+  if (devname == NULL)
   {
-    RS232_FPRINTF(stderr, "Unable to set comport settings.\n");
-    CloseHandle(fd);
+    RS232_FPRINTF(stderr, "Illegal device.\n");
+    SetLastError(ERROR_INVALID_PARAMETER);
     return RS232_INVALID_FD;
   }
 
-  COMMTIMEOUTS Cptimeouts;
+  /*
+   * https://msdn.microsoft.com/en-us/library/windows/desktop/aa363145%28v=vs.85%29.aspx
+   * https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-buildcommdcbandtimeoutsa
+   *
+   * https://technet.microsoft.com/en-us/library/cc732236.aspx
+   * https://docs.microsoft.com/en-us/previous-versions/windows/it-pro/windows-server-2012-R2-and-2012/cc732236(v=ws.11)
+   *
+   * https://docs.microsoft.com/en-us/windows/desktop/api/winbase/ns-winbase-_dcb
+   * https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-buildcommdcba
+   */
 
-  Cptimeouts.ReadIntervalTimeout = MAXDWORD;
-  Cptimeouts.ReadTotalTimeoutMultiplier = 0;
-  Cptimeouts.ReadTotalTimeoutConstant = 0;
-  Cptimeouts.WriteTotalTimeoutMultiplier = 0;
-  Cptimeouts.WriteTotalTimeoutConstant = 0;
+  RS232_FD fd = CreateFileA(devname,
+                            GENERIC_READ | GENERIC_WRITE,
+                            #if WITH_RS232_LOCK
+                            0,                          /* No share: access locked. */
+                            #else
+                            FILE_SHARE_READ | FILE_SHARE_WRITE, /* Share for read and write. */
+                            #endif
+                            NULL,                       /* No security. */
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,
+                            NULL);                      /* No templates. */
 
-  if (!SetCommTimeouts(fd, &Cptimeouts))
+  if (fd == RS232_INVALID_FD)
   {
-    RS232_FPRINTF(stderr, "Unable to set comport timeouts.\n");
+    RS232_FPRINTF(stderr, "Unable to open comport %s.\n", devname);
+    return RS232_INVALID_FD;
+  }
+
+  DCB port_settings;
+
+  if (!GetCommState(fd, &port_settings))
+  {
+    RS232_FPRINTF(stderr, "Unable to get comport settings.\n");
     CloseHandle(fd);
     return RS232_INVALID_FD;
   }
 
-  if (!SetCommMask(fd, EV_ERR))
+  if (_RS232_SetupDCB(&port_settings, baudrate, mode, flags) == -1)
   {
-    RS232_FPRINTF(stderr, "Unable to clear event mask.\n");
     CloseHandle(fd);
+    SetLastError(ERROR_INVALID_PARAMETER);
     return RS232_INVALID_FD;
   }
 
-  return fd;
-}
+  if (!SetCommState(fd, &port_settings))
+  {
+    RS232_FPRINTF(stderr, "Unable to set comport settings.\n");
+    CloseHandle(fd);
+    return RS232_INVALID_FD;
+  }
+
+  COMMTIMEOUTS Cptimeouts;
+
+  Cptimeouts.ReadIntervalTimeout = MAXDWORD;
+  Cptimeouts.ReadTotalTimeoutMultiplier = 0;
+  Cptimeouts.ReadTotalTimeoutConstant = 0;
+  Cptimeouts.WriteTotalTimeoutMultiplier = 0;
+  Cptimeouts.WriteTotalTimeoutConstant = 0;
+
+  if (!SetCommTimeouts(fd, &Cptimeouts))
+  {
+    RS232_FPRINTF(stderr, "Unable to set comport timeouts.\n");
+    CloseHandle(fd);
+    return RS232_INVALID_FD;
+  }
+
+  if (!SetCommMask(fd, EV_ERR))
+  {
+    RS232_FPRINTF(stderr, "Unable to clear event mask.\n");
+    CloseHandle(fd);
+    return RS232_INVALID_FD;
+  }
+
+  return fd;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_Reconfigure(RS232_FD fd, int baudrate, const char *mode, int flags)
+{
+
+  DCB port_settings;
+
+  if (!GetCommState(fd, &port_settings))
+  {
+    RS232_FPRINTF(stderr, "Unable to get comport settings.\n");
+    return -1;
+  }
+
+  if (_RS232_SetupDCB(&port_settings, baudrate, mode, flags) == -1) return -1;
+
+  /* Wait until all data written has been transmitted. */
+  if ((flags & RS232_FLAGS_DRAIN) && !FlushFileBuffers(fd)) return -1;
+
+  if (!SetCommState(fd, &port_settings))
+  {
+    RS232_FPRINTF(stderr, "Unable to set comport settings.\n");
+    return -1;
+  }
+
+  return 0;
+}
 
-static ssize_t _RS232_Read(RS232_FD fd, void *buf, size_t size, int flags, int timeout_msec)
+/* The waiting is done by the driver, there are no system calls to count. */
+static ssize_t _RS232_Read(RS232_FD fd, void *buf, size_t size, int flags, const struct timespec *timeout, _RS232_Syscalls *count)
 {
 
   ssize_t read_bytes;
+  DWORD timeout_msec = timeout ? (DWORD)timespec_to_msec_ceil(timeout) : MAXDWORD - 1;
   DWORD dwRead, lastError;
   COMMTIMEOUTS Cptimeouts;
   OVERLAPPED ov = { 0 };
-  (void)flags;
+  (void)flags; (void)count;
 
   if (!GetCommTimeouts(fd, &Cptimeouts)) return (ssize_t)-1;
 
@@ -854,14 +1426,15 @@ static ssize_t _RS232_Read(RS232_FD fd, void *buf, size_t size, int flags, int t
   return read_bytes;
 }
 
-static ssize_t _RS232_Write(RS232_FD fd, const void *buf, size_t size, int flags, int timeout_msec)
+static ssize_t _RS232_Write(RS232_FD fd, const void *buf, size_t size, int flags, const struct timespec *timeout, _RS232_Syscalls *count)
 {
 
   ssize_t written_bytes;
+  DWORD timeout_msec = timeout ? (DWORD)timespec_to_msec_ceil(timeout) : MAXDWORD - 1;
   DWORD dwWritten, lastError;
   COMMTIMEOUTS Cptimeouts;
   OVERLAPPED ov = { 0 };
-  (void)flags;
+  (void)flags; (void)count;
 
   if (!GetCommTimeouts(fd, &Cptimeouts)) return (ssize_t)-1;
 
@@ -891,6 +1464,21 @@ static ssize_t _RS232_Write(RS232_FD fd, const void *buf, size_t size, int flags
   return written_bytes;
 }
 
+/* Overlapped I/O has no scatter/gather for comports, only the first element is transferred. */
+static ssize_t _RS232_Readv(RS232_FD fd, const RS232_IOVec *iov, int iovcnt, int flags, const struct timespec *timeout)
+{
+
+  (void)iovcnt;
+  return _RS232_Read(fd, iov[0].iov_base, iov[0].iov_len, flags, timeout, NULL);
+}
+
+static ssize_t _RS232_Writev(RS232_FD fd, const RS232_IOVec *iov, int iovcnt, int flags, const struct timespec *timeout)
+{
+
+  (void)iovcnt;
+  return _RS232_Write(fd, iov[0].iov_base, iov[0].iov_len, flags, timeout, NULL);
+}
+
 RS232_ADDAPI int RS232_ADDCALL RS232_Close(RS232_FD fd)
 {
 
@@ -902,6 +1490,19 @@ RS232_ADDAPI int RS232_ADDCALL RS232_Close(RS232_FD fd)
  * https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-getcommmodemstatus
  */
 
+RS232_ADDAPI int RS232_ADDCALL RS232_GetModemLines(RS232_FD fd)
+{
+
+  DWORD status;
+
+  if (!GetCommModemStatus(fd, &status)) return -1;
+
+  return ((status & MS_CTS_ON) ? RS232_LINE_CTS : 0) |
+         ((status & MS_DSR_ON) ? RS232_LINE_DSR : 0) |
+         ((status & MS_RLSD_ON) ? RS232_LINE_DCD : 0) |
+         ((status & MS_RING_ON) ? RS232_LINE_RI : 0);
+}
+
 RS232_ADDAPI int RS232_ADDCALL RS232_IsDCDEnabled(RS232_FD fd)
 {
 
@@ -943,6 +1544,76 @@ RS232_ADDAPI int RS232_ADDCALL RS232_IsDSREnabled(RS232_FD fd)
   return (status & MS_DSR_ON) ? 1 : 0;
 }
 
+RS232_ADDAPI int RS232_ADDCALL RS232_SetModemLines(RS232_FD fd, int set, int clear)
+{
+
+  if (((set | clear) & ~(RS232_LINE_DTR | RS232_LINE_RTS)) != 0 || (set & clear) != 0) return -1;
+
+  if ((set & RS232_LINE_DTR) && !EscapeCommFunction(fd, SETDTR)) return -1;
+  if ((set & RS232_LINE_RTS) && !EscapeCommFunction(fd, SETRTS)) return -1;
+  if ((clear & RS232_LINE_DTR) && !EscapeCommFunction(fd, CLRDTR)) return -1;
+  if ((clear & RS232_LINE_RTS) && !EscapeCommFunction(fd, CLRRTS)) return -1;
+
+  return 0;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_SetRS485(RS232_FD fd, const RS232_RS485Config *config)
+{
+
+  DCB port_settings;
+
+  if (config != NULL && (!config->rts_on_send || config->delay_before_send_msec != 0 || config->delay_after_send_msec != 0))
+  {
+    return -1; /* Only what RTS_CONTROL_TOGGLE can do. */
+  }
+
+  memset(&port_settings, 0, sizeof(port_settings));
+  port_settings.DCBlength = sizeof(port_settings);
+
+  if (!GetCommState(fd, &port_settings)) return -1;
+
+  port_settings.fRtsControl = (config != NULL) ? RTS_CONTROL_TOGGLE : RTS_CONTROL_ENABLE;
+
+  return SetCommState(fd, &port_settings) ? 0 : -1;
+}
+
+/* The output lines can't be read back on Windows, the shadow starts from the configured state. */
+static int _RS232_ModemShadowInit(RS232_FD fd, int *shadow)
+{
+
+  DCB port_settings;
+
+  memset(&port_settings, 0, sizeof(port_settings));
+  port_settings.DCBlength = sizeof(port_settings);
+
+  if (!GetCommState(fd, &port_settings)) return -1;
+
+  *shadow = ((port_settings.fDtrControl == DTR_CONTROL_ENABLE) ? RS232_LINE_DTR : 0) |
+            ((port_settings.fRtsControl == RTS_CONTROL_ENABLE) ? RS232_LINE_RTS : 0);
+
+  return 0;
+}
+
+/* Changes only the output lines not yet in the requested state. */
+static int _RS232_ModemShadowApply(RS232_FD fd, int *shadow, int set, int clear)
+{
+
+  set &= ~*shadow;
+  clear &= *shadow;
+
+  if (RS232_SetModemLines(fd, set, clear) != 0) return -1;
+
+  *shadow = (*shadow | set) & ~clear;
+
+  return 0;
+}
+
+static int _RS232_ModemShadowLines(int shadow)
+{
+
+  return shadow;
+}
+
 RS232_ADDAPI int RS232_ADDCALL RS232_enableDTR(RS232_FD fd)
 {
 
@@ -1027,22 +1698,203 @@ RS232_ADDAPI int RS232_ADDCALL RS232_flushRXTX(RS232_FD fd)
          ? 0 : -1;
 }
 
+RS232_ADDAPI int RS232_ADDCALL RS232_BytesAvailable(RS232_FD fd)
+{
+
+  COMSTAT status;
+
+  if (!ClearCommError(fd, NULL, &status))
+  {
+    RS232_FPRINTF(stderr, "Unable to get the amount of received bytes.\n");
+    return -1;
+  }
+
+  return (int)status.cbInQue;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_BytesPending(RS232_FD fd)
+{
+
+  COMSTAT status;
+
+  if (!ClearCommError(fd, NULL, &status))
+  {
+    RS232_FPRINTF(stderr, "Unable to get the amount of bytes to send.\n");
+    return -1;
+  }
+
+  return (int)status.cbOutQue;
+}
+
+/* The driver can't tell, FlushFileBuffers does the waiting. */
+static int _RS232_TransmitterEmpty(RS232_FD fd)
+{
+
+  (void)fd;
+
+  return -1;
+}
+
+/* Waits until the driver has transmitted all data. */
+static int _RS232_Drain(RS232_FD fd)
+{
+
+  if (!FlushFileBuffers(fd))
+  {
+    RS232_FPRINTF(stderr, "Unable to drain.\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+static void _RS232_SleepUsec(long long usec)
+{
+
+  Sleep((DWORD)((usec + 999) / 1000));
+}
+
+static int _RS232_GetICounter(RS232_FD fd, RS232_ICounter *counter)
+{
+
+  (void)fd; (void)counter;
+  return -1;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_GetICounter(RS232_FD fd, RS232_ICounter *counter)
+{
+
+  (void)fd; (void)counter;
+  RS232_FPRINTF(stderr, "Interrupt counters are not supported on Windows.\n");
+  return -1;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_GetBaudrate(RS232_FD fd)
+{
+
+  DCB port_settings;
+
+  if (!GetCommState(fd, &port_settings)) return -1;
+
+  return (int)port_settings.BaudRate;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_SetReadTimeouts(RS232_FD fd, size_t min_size, int timeout_msec)
+{
+
+  (void)fd; (void)min_size; (void)timeout_msec;
+  return 0;
+}
+
+#endif
+
+/* Converts a relative timeout in milliseconds to an absolute deadline. Returns NULL for INT_MAX (no deadline). */
+static const struct timespec *_RS232_Deadline(struct timespec *deadline, int timeout_msec)
+{
+
+  if (timeout_msec == INT_MAX) return NULL;
+
+  timespec_deadline_usec(deadline, timeout_msec * 1000LL);
+
+  return deadline;
+}
+
+#if WITH_RS232_STATS
+
+static inline unsigned _RS232_StatsBucket(uint64_t value)
+{
+
+  unsigned bucket = (value > 0) ? 63u - (unsigned)__builtin_clzll(value) : 0u;
+
+  return (bucket < RS232_STATS_BUCKETS) ? bucket : RS232_STATS_BUCKETS - 1;
+}
+
+static inline void _RS232_StatsAdd(uint64_t *counter, uint64_t value)
+{
+
+  __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+/* Records a read or write call. Counter names are the same for both directions, see RS232_Stats. */
+#define _RS232_STATS_RECORD(stats, dir, result, size, start, count)                            \
+  do                                                                                             \
+  {                                                                                              \
+    struct timespec end, elapsed;                                                                \
+    clock_gettime(CLOCK_MONOTONIC, &end);                                                        \
+    timerspecsub(&end, &(start), &elapsed);                                                      \
+    uint64_t usec = (uint64_t)timespecsub_to_usec(&elapsed);                                     \
+    _RS232_StatsAdd(&(stats)->dir##_calls, 1);                                                  \
+    _RS232_StatsAdd(&(stats)->dir##_syscalls, (count).syscalls);                                \
+    _RS232_StatsAdd(&(stats)->dir##_polls, (count).polls);                                      \
+    _RS232_StatsAdd(&(stats)->dir##_usec, usec);                                                \
+    _RS232_StatsAdd(&(stats)->dir##_latency_hist[_RS232_StatsBucket(usec)], 1);                 \
+    if ((result) < 0)                                                                            \
+      _RS232_StatsAdd(&(stats)->dir##_errors, 1);                                               \
+    else if ((result) == 0)                                                                      \
+      _RS232_StatsAdd(&(stats)->dir##_timeouts, 1);                                             \
+    else                                                                                         \
+    {                                                                                            \
+      _RS232_StatsAdd(&(stats)->dir##_bytes, (uint64_t)(result));                               \
+      if ((size_t)(result) < (size)) _RS232_StatsAdd(&(stats)->dir##_partial, 1);               \
+    }                                                                                            \
+  } while (0)
+
+static ssize_t _RS232_ReadStats(RS232_Stats *stats, RS232_FD fd, void *buf, size_t size, int flags, const struct timespec *timeout)
+{
+
+  struct timespec start;
+  _RS232_Syscalls count = { 0, 0 };
+
+  if (stats == NULL) return _RS232_Read(fd, buf, size, flags, timeout, NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  ssize_t read_bytes = _RS232_Read(fd, buf, size, flags, timeout, &count);
+
+  _RS232_STATS_RECORD(stats, read, read_bytes, size, start, count);
+  if (read_bytes > 0) _RS232_StatsAdd(&stats->read_size_hist[_RS232_StatsBucket((uint64_t)read_bytes)], 1);
+
+  return read_bytes;
+}
+
+static ssize_t _RS232_WriteStats(RS232_Stats *stats, RS232_FD fd, const void *buf, size_t size, int flags, const struct timespec *timeout)
+{
+
+  struct timespec start;
+  _RS232_Syscalls count = { 0, 0 };
+
+  if (stats == NULL) return _RS232_Write(fd, buf, size, flags, timeout, NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  ssize_t written_bytes = _RS232_Write(fd, buf, size, flags, timeout, &count);
+
+  _RS232_STATS_RECORD(stats, write, written_bytes, size, start, count);
+
+  return written_bytes;
+}
+
+#else
+
+#define _RS232_ReadStats(stats, fd, buf, size, flags, timeout)   ((void)(stats), _RS232_Read(fd, buf, size, flags, timeout, NULL))
+#define _RS232_WriteStats(stats, fd, buf, size, flags, timeout)  ((void)(stats), _RS232_Write(fd, buf, size, flags, timeout, NULL))
+
 #endif
 
-RS232_ADDAPI ssize_t RS232_ADDCALL RS232_Read(RS232_FD fd, void *_buf, size_t size, int flags, int timeout_msec)
+static ssize_t _RS232_ReadUntil(RS232_Stats *stats, RS232_FD fd, void *_buf, size_t size, int flags, const struct timespec *deadline)
 {
 
   ssize_t total = 0;
   uint8_t *buf = _buf;
-  struct timespec start, end, diff;
+  struct timespec timeout;
+
+  if (deadline != NULL) timespec_remaining(deadline, &timeout);
 
   while (size > 0)
   {
     RS232_FPRINTF_DEBUG(stderr, "%s:%d: %p, %zu\n", __FUNCTION__, __LINE__, buf, size);
 
-    clock_gettime(CLOCK_MONOTONIC, &start);
-    ssize_t read_bytes = _RS232_Read(fd, buf, size, flags, timeout_msec);
-    clock_gettime(CLOCK_MONOTONIC, &end);
+    ssize_t read_bytes = _RS232_ReadStats(stats, fd, buf, size, flags, deadline ? &timeout : NULL);
 
     if (read_bytes < 0) break; /* Break on error. */
 
@@ -1050,29 +1902,86 @@ RS232_ADDAPI ssize_t RS232_ADDCALL RS232_Read(RS232_FD fd, void *_buf, size_t si
     size -= read_bytes;
     total += read_bytes;
 
-    timerspecsub(&end, &start, &diff);
-    timeout_msec -= timespecsub_to_msec(&diff);
+    if ((flags & RS232_FLAGS_READSOME) && total > 0) break;
+
+    if (deadline != NULL && !timespec_remaining(deadline, &timeout)) break; /* Time is up. */
+  }
+
+  return total;
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_ReadUntil(RS232_FD fd, void *buf, size_t size, int flags, const struct timespec *deadline)
+{
+
+  return _RS232_ReadUntil(NULL, fd, buf, size, flags, deadline);
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_Read(RS232_FD fd, void *buf, size_t size, int flags, int timeout_msec)
+{
+
+  struct timespec deadline;
+
+  return RS232_ReadUntil(fd, buf, size, flags, _RS232_Deadline(&deadline, timeout_msec));
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_ReadSome(RS232_FD fd, void *_buf, size_t size, size_t min_size, int flags, int timeout_msec, int idle_timeout_msec)
+{
+
+  ssize_t total = 0;
+  uint8_t *buf = _buf;
+  struct timespec deadline_buf, timeout, idle;
+  const struct timespec *deadline = _RS232_Deadline(&deadline_buf, timeout_msec);
+
+  if (min_size == 0) min_size = 1;
+  if (min_size > size) min_size = size;
+
+  idle.tv_sec = idle_timeout_msec / 1000;
+  idle.tv_nsec = (idle_timeout_msec % 1000) * 1000000L;
+
+  if (deadline != NULL) timespec_remaining(deadline, &timeout);
+
+  while (size > 0)
+  {
+    const struct timespec *wait = deadline ? &timeout : NULL;
+
+    if ((size_t)total >= min_size)
+    {
+      if (idle_timeout_msec <= 0) break; /* Enough data, don't wait for more. */
+      if (wait == NULL || timespec_before(&idle, wait)) wait = &idle;
+    }
+
+    RS232_FPRINTF_DEBUG(stderr, "%s:%d: %p, %zu\n", __FUNCTION__, __LINE__, buf, size);
+
+    ssize_t read_bytes = _RS232_Read(fd, buf, size, flags, wait, NULL);
+
+    if (read_bytes < 0) break; /* Break on error. */
+
+    if (read_bytes == 0 && (size_t)total >= min_size) break; /* Line is idle. */
+
+    buf += read_bytes;
+    size -= read_bytes;
+    total += read_bytes;
 
-    if (timeout_msec <= 0) break; /* Time is up. */
+    if (deadline != NULL && !timespec_remaining(deadline, &timeout)) break; /* Time is up. */
   }
 
   return total;
 }
 
-RS232_ADDAPI ssize_t RS232_ADDCALL RS232_Write(RS232_FD fd, const void *_buf, size_t size, int flags, int timeout_msec)
+static ssize_t _RS232_WriteUntil(RS232_Stats *stats, RS232_FD fd, const void *_buf, size_t size, int flags, const struct timespec *deadline)
 {
 
   ssize_t total = 0;
   const uint8_t *buf = _buf;
-  struct timespec start, end, diff;
+  struct timespec timeout;
+
+  if (deadline != NULL) timespec_remaining(deadline, &timeout);
 
   while (size > 0)
   {
     RS232_FPRINTF_DEBUG(stderr, "%s:%d: %p, %zu\n", __FUNCTION__, __LINE__, buf, size);
 
-    clock_gettime(CLOCK_MONOTONIC, &start);
-    ssize_t written_bytes = _RS232_Write(fd, buf, size, flags, timeout_msec);
-    clock_gettime(CLOCK_MONOTONIC, &end);
+    ssize_t written_bytes = _RS232_WriteStats(stats, fd, buf, size, flags, deadline ? &timeout : NULL);
 
     if (written_bytes < 0) break; /* Break on error. */
 
@@ -1080,28 +1989,2668 @@ RS232_ADDAPI ssize_t RS232_ADDCALL RS232_Write(RS232_FD fd, const void *_buf, si
     size -= written_bytes;
     total += written_bytes;
 
-    timerspecsub(&end, &start, &diff);
-    timeout_msec -= timespecsub_to_msec(&diff);
-
-    if (timeout_msec <= 0) break; /* Time is up. */
+    if (deadline != NULL && !timespec_remaining(deadline, &timeout)) break; /* Time is up. */
   }
 
   return total;
 }
 
-RS232_ADDAPI RS232_FD RS232_ADDCALL RS232_Open(const char *devname, int baudrate, const char *mode, int flags)
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_WriteUntil(RS232_FD fd, const void *buf, size_t size, int flags, const struct timespec *deadline)
 {
 
-  int attempts = 15; /* Empirical value to wait up to 15 seconds. */
+  return _RS232_WriteUntil(NULL, fd, buf, size, flags, deadline);
+}
 
-  RS232_FD fd = _RS232_Open(devname, baudrate, mode, flags);
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_Write(RS232_FD fd, const void *buf, size_t size, int flags, int timeout_msec)
+{
 
-  while (fd == RS232_INVALID_FD && attempts > 0)
-  {
-    msleep(1000);
-    fd = _RS232_Open(devname, baudrate, mode, flags);
-    attempts--;
-  }
+  struct timespec deadline;
 
-  return fd;
-}
\ No newline at end of file
+  return RS232_WriteUntil(fd, buf, size, flags, _RS232_Deadline(&deadline, timeout_msec));
+}
+
+#define RS232_IOV_BATCH  64   /* Maximal number of elements passed to a single readv/writev. */
+
+/*
+ * Position within an iovec array. Fills batch with the elements from the current position on,
+ * the first one shortened by what has already been transferred.
+ */
+typedef struct
+{
+  const RS232_IOVec *iov;
+  int iovcnt;
+  int index;
+  size_t offset;
+} _RS232_IOVecPos;
+
+static void _RS232_IOVecSkipEmpty(_RS232_IOVecPos *pos)
+{
+
+  while (pos->index < pos->iovcnt && pos->offset == pos->iov[pos->index].iov_len)
+  {
+    pos->index++;
+    pos->offset = 0;
+  }
+}
+
+static int _RS232_IOVecBatch(const _RS232_IOVecPos *pos, RS232_IOVec *batch)
+{
+
+  int n = 0;
+
+  for (int i = pos->index; i < pos->iovcnt && n < RS232_IOV_BATCH; i++)
+  {
+    size_t offset = (i == pos->index) ? pos->offset : 0;
+
+    if (pos->iov[i].iov_len == offset) continue;
+
+    batch[n].iov_base = (uint8_t *)pos->iov[i].iov_base + offset;
+    batch[n].iov_len = pos->iov[i].iov_len - offset;
+    n++;
+  }
+
+  return n;
+}
+
+static void _RS232_IOVecAdvance(_RS232_IOVecPos *pos, size_t n)
+{
+
+  while (n > 0 && pos->index < pos->iovcnt)
+  {
+    size_t left = pos->iov[pos->index].iov_len - pos->offset;
+
+    if (n < left)
+    {
+      pos->offset += n;
+      break;
+    }
+
+    n -= left;
+    pos->index++;
+    pos->offset = 0;
+  }
+
+  _RS232_IOVecSkipEmpty(pos);
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_Readv(RS232_FD fd, const RS232_IOVec *iov, int iovcnt, int flags, int timeout_msec)
+{
+
+  ssize_t total = 0;
+  RS232_IOVec batch[RS232_IOV_BATCH];
+  _RS232_IOVecPos pos = { iov, iovcnt, 0, 0 };
+  struct timespec deadline_buf, timeout;
+  const struct timespec *deadline = _RS232_Deadline(&deadline_buf, timeout_msec);
+
+  if (iov == NULL || iovcnt < 0) return -1;
+
+  _RS232_IOVecSkipEmpty(&pos);
+
+  if (deadline != NULL) timespec_remaining(deadline, &timeout);
+
+  while (pos.index < pos.iovcnt)
+  {
+    int n = _RS232_IOVecBatch(&pos, batch);
+
+    ssize_t read_bytes = _RS232_Readv(fd, batch, n, flags, deadline ? &timeout : NULL);
+
+    if (read_bytes < 0) break; /* Break on error. */
+
+    _RS232_IOVecAdvance(&pos, read_bytes);
+    total += read_bytes;
+
+    if ((flags & RS232_FLAGS_READSOME) && total > 0) break;
+
+    if (deadline != NULL && !timespec_remaining(deadline, &timeout)) break; /* Time is up. */
+  }
+
+  return total;
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_Writev(RS232_FD fd, const RS232_IOVec *iov, int iovcnt, int flags, int timeout_msec)
+{
+
+  ssize_t total = 0;
+  RS232_IOVec batch[RS232_IOV_BATCH];
+  _RS232_IOVecPos pos = { iov, iovcnt, 0, 0 };
+  struct timespec deadline_buf, timeout;
+  const struct timespec *deadline = _RS232_Deadline(&deadline_buf, timeout_msec);
+
+  if (iov == NULL || iovcnt < 0) return -1;
+
+  _RS232_IOVecSkipEmpty(&pos);
+
+  if (deadline != NULL) timespec_remaining(deadline, &timeout);
+
+  while (pos.index < pos.iovcnt)
+  {
+    int n = _RS232_IOVecBatch(&pos, batch);
+
+    ssize_t written_bytes = _RS232_Writev(fd, batch, n, flags, deadline ? &timeout : NULL);
+
+    if (written_bytes < 0) break; /* Break on error. */
+
+    _RS232_IOVecAdvance(&pos, written_bytes);
+    total += written_bytes;
+
+    if (deadline != NULL && !timespec_remaining(deadline, &timeout)) break; /* Time is up. */
+  }
+
+  return total;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_Drain(RS232_FD fd, const struct timespec *deadline)
+{
+
+  struct timespec remaining;
+
+  if (deadline == NULL) return _RS232_Drain(fd);
+
+  /* Poll the output queue, then the transmit shift register, so that the deadline is kept. */
+  int baudrate = RS232_GetBaudrate(fd);
+  long long char_usec = (baudrate > 0) ? 10 * 1000000LL / baudrate : 1000;
+
+  for (;;)
+  {
+    int pending = RS232_BytesPending(fd);
+    if (pending == -1) return -1;
+
+    if (pending == 0)
+    {
+      int empty = _RS232_TransmitterEmpty(fd);
+
+      if (empty == 1) return 0;
+      if (empty == -1) break;
+      pending = 1;  /* Last characters are in the UART. */
+    }
+
+    if (!timespec_remaining(deadline, &remaining)) return -1; /* Time is up. */
+
+    long long usec = pending * char_usec;
+    long long remaining_usec = timespecsub_to_usec(&remaining);
+
+    if (usec > remaining_usec) usec = remaining_usec;
+    _RS232_SleepUsec(usec > 100 ? usec : 100);
+  }
+
+  /* Without a transmitter status only the driver knows, it waits for the hardware FIFO at most. */
+  if (!timespec_remaining(deadline, &remaining)) return -1; /* Time is up. */
+
+  return _RS232_Drain(fd);
+}
+
+/*
+ * The receive buffer is linear rather than circular: data is moved to the front when the free
+ * space at the end runs low, so peek always sees all buffered bytes in one contiguous block.
+ */
+struct RS232_RxBuffer
+{
+  RS232_FD fd;
+  uint8_t *data;
+  size_t capacity;
+  size_t head;                  /* First unconsumed byte. */
+  size_t tail;                  /* One past the last received byte. */
+  RS232_Stats *stats;           /* Counters of the owning port or NULL. */
+  bool discard;                 /* Frame reading drops everything up to and including the next delimiter. */
+};
+
+RS232_ADDAPI RS232_RxBuffer * RS232_ADDCALL RS232_RxBufferCreate(RS232_FD fd, size_t capacity)
+{
+
+  if (capacity == 0) return NULL;
+
+  RS232_RxBuffer *rb = calloc(1, sizeof(*rb));
+  if (rb == NULL) return NULL;
+
+  rb->data = malloc(capacity);
+  if (rb->data == NULL)
+  {
+    free(rb);
+    return NULL;
+  }
+
+  rb->fd = fd;
+  rb->capacity = capacity;
+
+  return rb;
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_RxBufferDestroy(RS232_RxBuffer *rb)
+{
+
+  if (rb == NULL) return;
+
+  free(rb->data);
+  free(rb);
+}
+
+static ssize_t _RS232_RxBufferFill(RS232_RxBuffer *rb, int flags, const struct timespec *deadline)
+{
+
+  struct timespec timeout;
+
+  if (rb->head == rb->tail)
+  {
+    rb->head = rb->tail = 0;
+  }
+  else if (rb->head > 0 && (rb->tail == rb->capacity || rb->capacity - rb->tail < rb->capacity / 4))
+  {
+    /* Compact once the free space at the end runs low, always if there is none left. */
+    memmove(rb->data, rb->data + rb->head, rb->tail - rb->head);
+    rb->tail -= rb->head;
+    rb->head = 0;
+  }
+
+  if (rb->tail == rb->capacity) return 0; /* Full. */
+
+  if (deadline != NULL) timespec_remaining(deadline, &timeout);
+
+  ssize_t read_bytes = _RS232_ReadStats(rb->stats, rb->fd, rb->data + rb->tail, rb->capacity - rb->tail, flags, deadline ? &timeout : NULL);
+  if (read_bytes > 0) rb->tail += read_bytes;
+
+  return read_bytes;
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_RxBufferFill(RS232_RxBuffer *rb, int flags, int timeout_msec)
+{
+
+  struct timespec deadline;
+
+  if (rb == NULL) return -1;
+
+  return _RS232_RxBufferFill(rb, flags, _RS232_Deadline(&deadline, timeout_msec));
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_RxBufferPeek(RS232_RxBuffer *rb, const void **data, size_t *len)
+{
+
+  if (rb == NULL || data == NULL || len == NULL) return -1;
+
+  *data = rb->data + rb->head;
+  *len = rb->tail - rb->head;
+
+  return 0;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_RxBufferConsume(RS232_RxBuffer *rb, size_t n)
+{
+
+  if (rb == NULL || n > rb->tail - rb->head) return -1;
+
+  rb->head += n;
+  if (rb->head == rb->tail) rb->head = rb->tail = 0;
+
+  return 0;
+}
+
+/*
+ * Returns the offset of the first byte in p that is one of delims, or len if there is none.
+ * A single delimiter is left to memchr, which libc vectorizes. Several delimiters are compared
+ * 16 bytes at a time with SSE2 where available, otherwise looked up in a table.
+ */
+static size_t _RS232_FindAny(const uint8_t *p, size_t len, const uint8_t *delims, size_t ndelims)
+{
+
+  size_t i = 0;
+
+  if (ndelims == 1)
+  {
+    const uint8_t *found = memchr(p, delims[0], len);
+    return found ? (size_t)(found - p) : len;
+  }
+
+#if defined(__SSE2__)
+  if (ndelims <= 8)
+  {
+    __m128i needles[8];
+
+    for (size_t k = 0; k < ndelims; k++)
+    {
+      needles[k] = _mm_set1_epi8((char)delims[k]);
+    }
+
+    for (; i + 16 <= len; i += 16)
+    {
+      __m128i block = _mm_loadu_si128((const __m128i *)(p + i));
+      __m128i match = _mm_cmpeq_epi8(block, needles[0]);
+
+      for (size_t k = 1; k < ndelims; k++)
+      {
+        match = _mm_or_si128(match, _mm_cmpeq_epi8(block, needles[k]));
+      }
+
+      int mask = _mm_movemask_epi8(match);
+      if (mask != 0) return i + (size_t)__builtin_ctz((unsigned)mask);
+    }
+  }
+#endif
+
+  bool is_delim[256] = { false };
+
+  for (size_t k = 0; k < ndelims; k++)
+  {
+    is_delim[delims[k]] = true;
+  }
+
+  for (; i < len; i++)
+  {
+    if (is_delim[p[i]]) return i;
+  }
+
+  return len;
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_RxBufferReadFrame(RS232_RxBuffer *rb, const void *delims, size_t ndelims, int flags, int timeout_msec, const void **frame)
+{
+
+  struct timespec deadline_buf, remaining;
+  const struct timespec *deadline = _RS232_Deadline(&deadline_buf, timeout_msec);
+  size_t scanned = 0;          /* Bytes already known not to be delimiters, relative to head. */
+  bool time_left = true;
+
+  if (rb == NULL || delims == NULL || ndelims == 0 || frame == NULL) return -1;
+
+  while (true)
+  {
+    size_t len = rb->tail - rb->head;
+    size_t pos = scanned + _RS232_FindAny(rb->data + rb->head + scanned, len - scanned, delims, ndelims);
+
+    if (pos < len || len == rb->capacity)
+    {
+      /* A full buffer without delimiter is handed out as it is. */
+      size_t frame_len = (pos < len) ? pos + 1 : len;
+
+      if (rb->discard)
+      {
+        RS232_RxBufferConsume(rb, frame_len);
+        rb->discard = (pos == len);
+        scanned = 0;
+        continue;
+      }
+
+      *frame = rb->data + rb->head;
+      RS232_RxBufferConsume(rb, frame_len);
+
+      return (ssize_t)frame_len;
+    }
+
+    scanned = len;
+
+    if (!time_left) return 0; /* Time is up. */
+
+    if (_RS232_RxBufferFill(rb, flags, deadline) < 0) return -1;
+
+    if (deadline != NULL) time_left = timespec_remaining(deadline, &remaining);
+  }
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_RxBufferDiscardFrame(RS232_RxBuffer *rb)
+{
+
+  if (rb == NULL) return -1;
+
+  rb->discard = true;
+
+  return 0;
+}
+
+static ssize_t _RS232_RxBufferRead(RS232_RxBuffer *rb, void *_buf, size_t size, int flags, const struct timespec *deadline)
+{
+
+  ssize_t total = 0;
+  uint8_t *buf = _buf;
+  struct timespec timeout;
+  bool time_left = true;
+
+  if (rb == NULL) return -1;
+
+  while (size > 0)
+  {
+    size_t len = rb->tail - rb->head;
+
+    if (len > 0)
+    {
+      /* Serve buffered data first. */
+      if (len > size) len = size;
+
+      memcpy(buf, rb->data + rb->head, len);
+      RS232_RxBufferConsume(rb, len);
+
+      buf += len;
+      size -= len;
+      total += len;
+      continue;
+    }
+
+    if (!time_left) break; /* Time is up. */
+
+    if ((flags & RS232_FLAGS_READSOME) && total > 0) break;
+
+    ssize_t read_bytes;
+
+    if (size >= rb->capacity)
+    {
+      /* Large reads bypass the buffer, no point in copying twice. */
+      if (deadline != NULL) timespec_remaining(deadline, &timeout);
+      read_bytes = _RS232_ReadStats(rb->stats, rb->fd, buf, size, flags, deadline ? &timeout : NULL);
+      if (read_bytes > 0)
+      {
+        buf += read_bytes;
+        size -= read_bytes;
+        total += read_bytes;
+      }
+    }
+    else
+    {
+      read_bytes = _RS232_RxBufferFill(rb, flags, deadline);
+    }
+
+    if (read_bytes < 0) break; /* Break on error. */
+
+    if (deadline != NULL) time_left = timespec_remaining(deadline, &timeout);
+  }
+
+  return total;
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_RxBufferRead(RS232_RxBuffer *rb, void *buf, size_t size, int flags, int timeout_msec)
+{
+
+  struct timespec deadline;
+
+  return _RS232_RxBufferRead(rb, buf, size, flags, _RS232_Deadline(&deadline, timeout_msec));
+}
+
+/* Condition variables wait on CLOCK_MONOTONIC where supported, deadlines are CLOCK_MONOTONIC throughout. */
+static void _RS232_CondInit(pthread_cond_t *cond)
+{
+
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+#if defined(__linux__) || defined(__FreeBSD__)
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+  pthread_cond_init(cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+/* Returns 0 if signaled or spuriously woken up, ETIMEDOUT once the deadline has passed. */
+static int _RS232_CondWaitUntil(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *deadline)
+{
+
+  if (deadline == NULL) return pthread_cond_wait(cond, mutex);
+
+#if defined(__linux__) || defined(__FreeBSD__)
+  return pthread_cond_timedwait(cond, mutex, deadline);
+#else
+  struct timespec remaining, abstime;
+
+  if (!timespec_remaining(deadline, &remaining)) return ETIMEDOUT;
+
+  clock_gettime(CLOCK_REALTIME, &abstime);
+  timespecadd_usec(&abstime, timespecsub_to_usec(&remaining), &abstime);
+
+  return pthread_cond_timedwait(cond, mutex, &abstime);
+#endif
+}
+
+typedef struct _RS232_TxItem
+{
+  struct _RS232_TxItem *next;
+  RS232_TxCallback callback;
+  void *userdata;
+  int prio;
+  size_t size;
+  uint8_t data[];
+} _RS232_TxItem;
+
+struct RS232_TxQueue
+{
+  RS232_FD fd;
+  size_t max_bytes;
+  int write_timeout_msec;
+
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;        /* Signaled when an item is queued or the writer has to stop. */
+  pthread_cond_t drained;       /* Signaled when an item has been written. */
+  pthread_t writer;
+
+  _RS232_TxItem *head[RS232_TXPRIO_COUNT];     /* One lane per priority. */
+  _RS232_TxItem *tail[RS232_TXPRIO_COUNT];
+  size_t pending;               /* Bytes queued or being written. */
+  size_t lane_pending[RS232_TXPRIO_COUNT];     /* The same per priority, each limited to max_bytes. */
+  size_t outq_limit;            /* Maximal fill level of the kernel output queue, 0: no limit. */
+  int baudrate;
+  bool stop;
+};
+
+/* Takes the oldest item of the most urgent non-empty lane. Must be called locked. */
+static _RS232_TxItem *_RS232_TxQueuePop(RS232_TxQueue *q)
+{
+
+  for (int prio = 0; prio < RS232_TXPRIO_COUNT; prio++)
+  {
+    _RS232_TxItem *item = q->head[prio];
+
+    if (item == NULL) continue;
+
+    q->head[prio] = item->next;
+    if (q->head[prio] == NULL) q->tail[prio] = NULL;
+
+    return item;
+  }
+
+  return NULL;
+}
+
+/*
+ * Writes in chunks of at most outq_limit bytes and only when the kernel output queue has room
+ * for them, so that the queue stays shallow and an urgent item never waits behind much more
+ * than outq_limit bytes. The wait is estimated from the baudrate with 10 bits per character.
+ */
+static ssize_t _RS232_TxWrite(RS232_FD fd, const uint8_t *buf, size_t size, int timeout_msec, size_t outq_limit, int baudrate)
+{
+
+  ssize_t total = 0;
+  struct timespec deadline_buf, remaining;
+  const struct timespec *deadline = _RS232_Deadline(&deadline_buf, timeout_msec);
+
+  if (outq_limit == 0 || baudrate <= 0) return RS232_WriteUntil(fd, buf, size, 0, deadline);
+
+  while (size > 0)
+  {
+    size_t chunk = (size < outq_limit) ? size : outq_limit;
+    int outq = RS232_BytesPending(fd);
+
+    if (outq > 0 && (size_t)outq + chunk > outq_limit)
+    {
+      if (deadline != NULL && !timespec_remaining(deadline, &remaining)) break; /* Time is up. */
+
+      long long usec = (long long)((size_t)outq + chunk - outq_limit) * 10 * 1000000LL / baudrate;
+      _RS232_SleepUsec(usec > 100 ? usec : 100);
+      continue;
+    }
+
+    ssize_t written_bytes = RS232_WriteUntil(fd, buf, chunk, 0, deadline);
+    if (written_bytes <= 0) break;
+
+    buf += written_bytes;
+    size -= written_bytes;
+    total += written_bytes;
+
+    if ((size_t)written_bytes < chunk) break; /* Time is up. */
+  }
+
+  return total;
+}
+
+static void *_RS232_TxWriter(void *arg)
+{
+
+  RS232_TxQueue *q = arg;
+
+  pthread_mutex_lock(&q->lock);
+
+  while (true)
+  {
+    _RS232_TxItem *item = NULL;
+
+    while (!q->stop && (item = _RS232_TxQueuePop(q)) == NULL)
+    {
+      pthread_cond_wait(&q->wakeup, &q->lock);
+    }
+
+    if (item == NULL) break; /* Stopped. */
+
+    size_t outq_limit = q->outq_limit;
+    int baudrate = q->baudrate;
+
+    pthread_mutex_unlock(&q->lock);
+
+    ssize_t written_bytes = _RS232_TxWrite(q->fd, item->data, item->size, q->write_timeout_msec, outq_limit, baudrate);
+    if (written_bytes < (ssize_t)item->size)
+    {
+      RS232_FPRINTF_DEBUG(stderr, "Queued data sent partially: %zd of %zu bytes.\n", written_bytes, item->size);
+    }
+
+    if (item->callback != NULL) item->callback(written_bytes, item->userdata);
+
+    size_t size = item->size;
+    int prio = item->prio;
+    free(item);
+
+    pthread_mutex_lock(&q->lock);
+    q->pending -= size;
+    q->lane_pending[prio] -= size;
+    pthread_cond_broadcast(&q->drained);
+  }
+
+  pthread_mutex_unlock(&q->lock);
+
+  return NULL;
+}
+
+RS232_ADDAPI RS232_TxQueue * RS232_ADDCALL RS232_TxQueueCreate(RS232_FD fd, size_t max_bytes, int write_timeout_msec)
+{
+
+  RS232_TxQueue *q = calloc(1, sizeof(*q));
+  if (q == NULL) return NULL;
+
+  q->fd = fd;
+  q->max_bytes = max_bytes;
+  q->write_timeout_msec = write_timeout_msec;
+
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->wakeup, NULL);
+  _RS232_CondInit(&q->drained);
+
+  if (pthread_create(&q->writer, NULL, _RS232_TxWriter, q) != 0)
+  {
+    RS232_FPRINTF(stderr, "Unable to start writer thread.\n");
+    pthread_cond_destroy(&q->drained);
+    pthread_cond_destroy(&q->wakeup);
+    pthread_mutex_destroy(&q->lock);
+    free(q);
+    return NULL;
+  }
+
+  return q;
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_TxQueueDestroy(RS232_TxQueue *q)
+{
+
+  if (q == NULL) return;
+
+  pthread_mutex_lock(&q->lock);
+  q->stop = true;
+  pthread_cond_signal(&q->wakeup);
+  pthread_mutex_unlock(&q->lock);
+
+  pthread_join(q->writer, NULL);
+
+  /* Whatever hasn't been written is reported as failed. */
+  _RS232_TxItem *item;
+
+  while ((item = _RS232_TxQueuePop(q)) != NULL)
+  {
+    if (item->callback != NULL) item->callback(-1, item->userdata);
+    free(item);
+  }
+
+  pthread_cond_destroy(&q->drained);
+  pthread_cond_destroy(&q->wakeup);
+  pthread_mutex_destroy(&q->lock);
+  free(q);
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_TxQueueSend(RS232_TxQueue *q, const void *buf, size_t size, RS232_TxCallback callback, void *userdata)
+{
+
+  return RS232_TxQueueSendPrio(q, buf, size, RS232_TXPRIO_BULK, callback, userdata);
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_TxQueueSendPrio(RS232_TxQueue *q, const void *buf, size_t size, int prio,
+                                                    RS232_TxCallback callback, void *userdata)
+{
+
+  if (q == NULL || (buf == NULL && size > 0) || prio < 0 || prio >= RS232_TXPRIO_COUNT) return -1;
+
+  /* Would never fit, retrying on RS232_TXQUEUE_FULL would go on forever. */
+  if (size > q->max_bytes)
+  {
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  /* Every lane has a budget of its own, bulk data never takes the room of urgent data. */
+  pthread_mutex_lock(&q->lock);
+  bool full = (q->lane_pending[prio] + size > q->max_bytes);
+  pthread_mutex_unlock(&q->lock);
+
+  if (full) return RS232_TXQUEUE_FULL;
+
+  _RS232_TxItem *item = malloc(sizeof(*item) + size);
+  if (item == NULL) return -1;
+
+  item->next = NULL;
+  item->callback = callback;
+  item->userdata = userdata;
+  item->prio = prio;
+  item->size = size;
+  if (size > 0) memcpy(item->data, buf, size);
+
+  pthread_mutex_lock(&q->lock);
+
+  if (q->lane_pending[prio] + size > q->max_bytes)
+  {
+    /* Another thread was faster. */
+    pthread_mutex_unlock(&q->lock);
+    free(item);
+    return RS232_TXQUEUE_FULL;
+  }
+
+  if (q->tail[prio] != NULL)
+    q->tail[prio]->next = item;
+  else
+    q->head[prio] = item;
+  q->tail[prio] = item;
+  q->pending += size;
+  q->lane_pending[prio] += size;
+
+  pthread_cond_signal(&q->wakeup);
+  pthread_mutex_unlock(&q->lock);
+
+  return 0;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_TxQueueSetOutqLimit(RS232_TxQueue *q, size_t outq_limit)
+{
+
+  if (q == NULL) return -1;
+
+  int baudrate = RS232_GetBaudrate(q->fd);
+  if (outq_limit > 0 && baudrate <= 0) return -1;
+
+  pthread_mutex_lock(&q->lock);
+  q->outq_limit = outq_limit;
+  q->baudrate = baudrate;
+  pthread_mutex_unlock(&q->lock);
+
+  return 0;
+}
+
+RS232_ADDAPI size_t RS232_ADDCALL RS232_TxQueuePending(RS232_TxQueue *q)
+{
+
+  if (q == NULL) return 0;
+
+  pthread_mutex_lock(&q->lock);
+  size_t pending = q->pending;
+  pthread_mutex_unlock(&q->lock);
+
+  return pending;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_TxQueueFlush(RS232_TxQueue *q, int timeout_msec)
+{
+
+  struct timespec deadline_buf;
+  const struct timespec *deadline = _RS232_Deadline(&deadline_buf, timeout_msec);
+  int err = 0;
+
+  if (q == NULL) return -1;
+
+  pthread_mutex_lock(&q->lock);
+
+  while (q->pending > 0 && err == 0)
+  {
+    err = _RS232_CondWaitUntil(&q->drained, &q->lock, deadline);
+  }
+
+  bool empty = (q->pending == 0);
+  pthread_mutex_unlock(&q->lock);
+
+  return empty ? 0 : -1;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_OpenOptionsInit(RS232_OpenOptions *options)
+{
+
+  if (options == NULL) return -1;
+
+  options->max_attempts = 16;          /* Empirical value to wait up to 15 seconds. */
+  options->retry_delay_msec = 1000;
+  options->max_retry_delay_msec = 1000;
+  options->backoff_percent = 100;
+  options->timeout_msec = INT_MAX;
+  options->retry_missing = 1;
+
+  return 0;
+}
+
+/* Whether the last _RS232_Open failed for a reason another attempt can't change. */
+static bool _RS232_OpenPermanentError(const RS232_OpenOptions *options)
+{
+
+#if WINDOWS_BUILD
+  DWORD err = GetLastError();
+
+  if (err == ERROR_INVALID_PARAMETER) return true;
+  return !options->retry_missing && (err == ERROR_FILE_NOT_FOUND || err == ERROR_PATH_NOT_FOUND || err == ERROR_ACCESS_DENIED);
+#else
+  if (errno == EINVAL) return true;
+  return !options->retry_missing && (errno == ENOENT || errno == EACCES);
+#endif
+}
+
+RS232_ADDAPI RS232_FD RS232_ADDCALL RS232_OpenEx(const char *devname, int baudrate, const char *mode, int flags, const RS232_OpenOptions *options)
+{
+
+  RS232_OpenOptions defaults;
+  struct timespec deadline_buf, remaining;
+  const struct timespec *deadline;
+
+  if (options == NULL)
+  {
+    RS232_OpenOptionsInit(&defaults);
+    options = &defaults;
+  }
+
+  deadline = _RS232_Deadline(&deadline_buf, options->timeout_msec);
+
+  int attempts = options->max_attempts;
+  long long delay_msec = options->retry_delay_msec;
+
+  RS232_FD fd = _RS232_Open(devname, baudrate, mode, flags);
+
+  while (fd == RS232_INVALID_FD && --attempts > 0)
+  {
+    int sleep_msec = (int)delay_msec;
+
+    if (_RS232_OpenPermanentError(options)) break;
+
+    if (deadline != NULL)
+    {
+      if (!timespec_remaining(deadline, &remaining)) break; /* Time is up. */
+      if (timespec_to_msec_ceil(&remaining) < sleep_msec) sleep_msec = timespec_to_msec_ceil(&remaining);
+    }
+
+    if (sleep_msec > 0) msleep(sleep_msec);
+    fd = _RS232_Open(devname, baudrate, mode, flags);
+
+    delay_msec = delay_msec * options->backoff_percent / 100;
+    if (delay_msec > options->max_retry_delay_msec) delay_msec = options->max_retry_delay_msec;
+  }
+
+  return fd;
+}
+
+RS232_ADDAPI RS232_FD RS232_ADDCALL RS232_Open(const char *devname, int baudrate, const char *mode, int flags)
+{
+
+  return RS232_OpenEx(devname, baudrate, mode, flags, NULL);
+}
+
+typedef struct
+{
+  RS232_OpenSpec *specs;
+  size_t count;
+  size_t next;                  /* Next spec to be opened, protected by lock. */
+  const RS232_OpenOptions *options;
+  pthread_mutex_t lock;
+} _RS232_OpenBatch;
+
+static void *_RS232_OpenWorker(void *arg)
+{
+
+  _RS232_OpenBatch *batch = arg;
+
+  while (true)
+  {
+    pthread_mutex_lock(&batch->lock);
+    size_t i = batch->next++;
+    pthread_mutex_unlock(&batch->lock);
+
+    if (i >= batch->count) break;
+
+    RS232_OpenSpec *spec = &batch->specs[i];
+
+    spec->fd = RS232_OpenEx(spec->devname, spec->baudrate, spec->mode, spec->flags, batch->options);
+#if WINDOWS_BUILD
+    spec->error = (spec->fd == RS232_INVALID_FD) ? (int)GetLastError() : 0;
+#else
+    spec->error = (spec->fd == RS232_INVALID_FD) ? errno : 0;
+#endif
+  }
+
+  return NULL;
+}
+
+RS232_ADDAPI size_t RS232_ADDCALL RS232_OpenMany(RS232_OpenSpec *specs, size_t count, int max_workers, const RS232_OpenOptions *options)
+{
+
+  _RS232_OpenBatch batch;
+  pthread_t *threads;
+  size_t workers, started = 0, opened = 0;
+
+  if (specs == NULL || count == 0) return 0;
+
+  batch.specs = specs;
+  batch.count = count;
+  batch.next = 0;
+  batch.options = options;
+  pthread_mutex_init(&batch.lock, NULL);
+
+  /* The calling thread is a worker too. */
+  workers = (max_workers > 0) ? (size_t)max_workers : 16;
+  if (workers > count) workers = count;
+
+  threads = calloc(workers, sizeof(*threads));
+  if (threads != NULL)
+  {
+    for (size_t i = 1; i < workers; i++)
+    {
+      if (pthread_create(&threads[started], NULL, _RS232_OpenWorker, &batch) != 0) break;
+      started++;
+    }
+  }
+
+  _RS232_OpenWorker(&batch);
+
+  for (size_t i = 0; i < started; i++)
+  {
+    pthread_join(threads[i], NULL);
+  }
+
+  free(threads);
+  pthread_mutex_destroy(&batch.lock);
+
+  for (size_t i = 0; i < count; i++)
+  {
+    if (specs[i].fd != RS232_INVALID_FD) opened++;
+  }
+
+  return opened;
+}
+
+typedef struct
+{
+  char *devname;
+  char *mode;
+  int baudrate;
+  int flags;
+  RS232_OpenOptions options;
+  RS232_OpenCallback callback;
+  void *userdata;
+} _RS232_OpenRequest;
+
+static void _RS232_OpenRequestFree(_RS232_OpenRequest *req)
+{
+
+  free(req->devname);
+  free(req->mode);
+  free(req);
+}
+
+static void *_RS232_OpenThread(void *arg)
+{
+
+  _RS232_OpenRequest *req = arg;
+
+  RS232_FD fd = RS232_OpenEx(req->devname, req->baudrate, req->mode, req->flags, &req->options);
+  req->callback(fd, req->userdata);
+
+  _RS232_OpenRequestFree(req);
+
+  return NULL;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_OpenAsync(const char *devname, int baudrate, const char *mode, int flags, const RS232_OpenOptions *options,
+                                              RS232_OpenCallback callback, void *userdata)
+{
+
+  pthread_t thread;
+
+  if (devname == NULL || mode == NULL || callback == NULL) return -1;
+
+  _RS232_OpenRequest *req = calloc(1, sizeof(*req));
+  if (req == NULL) return -1;
+
+  req->devname = strdup(devname);
+  req->mode = strdup(mode);
+  if (req->devname == NULL || req->mode == NULL)
+  {
+    _RS232_OpenRequestFree(req);
+    return -1;
+  }
+
+  req->baudrate = baudrate;
+  req->flags = flags;
+  req->callback = callback;
+  req->userdata = userdata;
+
+  if (options != NULL)
+    req->options = *options;
+  else
+    RS232_OpenOptionsInit(&req->options);
+
+  if (pthread_create(&thread, NULL, _RS232_OpenThread, req) != 0)
+  {
+    RS232_FPRINTF(stderr, "Unable to start open thread.\n");
+    _RS232_OpenRequestFree(req);
+    return -1;
+  }
+
+  pthread_detach(thread);
+
+  return 0;
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_RS485ConfigInit(RS232_RS485Config *config)
+{
+
+  if (config == NULL) return;
+
+  config->rts_on_send = 1;
+  config->delay_before_send_msec = 0;
+  config->delay_after_send_msec = 0;
+  config->rx_during_tx = 0;
+}
+
+struct RS232_Port
+{
+  RS232_FD fd;
+  int baudrate;                 /* Actually set, see RS232_GetBaudrate. */
+  char mode[4];
+  int flags;
+  RS232_RxBuffer *rx;           /* NULL: reads go to the driver directly. */
+  RS232_Stats *stats;           /* Points to stats_data if enabled, NULL otherwise. */
+  RS232_Stats stats_data;
+  RS232_ICounter icount_last;   /* Baseline of RS232_PortGetICounterDelta. */
+  RS232_ICounter icount_monitor; /* Baseline of the counter monitor. */
+  pthread_mutex_t modem_lock;
+  int modem_shadow;             /* Output lines as last set, see _RS232_ModemShadowInit. */
+  bool modem_shadow_valid;      /* False if the driver can't report the lines. */
+  bool rs485_software;          /* RS232_PortWrite switches RTS, see RS232_PortSetRS485. */
+  RS232_RS485Config rs485;
+  bool rs485_async;             /* RTS switched to send by RS232_PortWriteAsync, waiting for RS232_PortWriteAsyncEnd. */
+  bool rs485_empty_seen;        /* The transmitter has been seen empty at rs485_empty_at. */
+  struct timespec rs485_empty_at;
+  struct RS232_Port *next;      /* Registry of open ports. */
+};
+
+/* Open ports, sampled by the counter monitor. */
+static pthread_mutex_t _RS232_PortsLock = PTHREAD_MUTEX_INITIALIZER;
+static RS232_Port *_RS232_Ports = NULL;
+
+static void _RS232_PortRegister(RS232_Port *port)
+{
+
+  pthread_mutex_lock(&_RS232_PortsLock);
+  port->next = _RS232_Ports;
+  _RS232_Ports = port;
+  pthread_mutex_unlock(&_RS232_PortsLock);
+}
+
+static void _RS232_PortUnregister(RS232_Port *port)
+{
+
+  pthread_mutex_lock(&_RS232_PortsLock);
+  for (RS232_Port **p = &_RS232_Ports; *p != NULL; p = &(*p)->next)
+  {
+    if (*p == port)
+    {
+      *p = port->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&_RS232_PortsLock);
+}
+
+RS232_ADDAPI RS232_Port * RS232_ADDCALL RS232_PortOpen(const char *devname, int baudrate, const char *mode, int flags, const RS232_OpenOptions *options)
+{
+
+  if (mode == NULL || strlen(mode) != 3) return NULL;
+
+  RS232_Port *port = calloc(1, sizeof(*port));
+  if (port == NULL) return NULL;
+
+  port->fd = RS232_OpenEx(devname, baudrate, mode, flags, options);
+  if (port->fd == RS232_INVALID_FD)
+  {
+    free(port);
+    return NULL;
+  }
+
+  port->baudrate = RS232_GetBaudrate(port->fd);
+  if (port->baudrate <= 0) port->baudrate = baudrate;
+  memcpy(port->mode, mode, sizeof(port->mode));
+  port->flags = flags;
+
+  pthread_mutex_init(&port->modem_lock, NULL);
+  port->modem_shadow_valid = (_RS232_ModemShadowInit(port->fd, &port->modem_shadow) == 0);
+
+  /* Deltas count from here on. Fails silently where the counters are not supported. */
+  if (_RS232_GetICounter(port->fd, &port->icount_last) == 0) port->icount_monitor = port->icount_last;
+
+  if ((flags & RS232_FLAGS_RS485) != 0)
+  {
+    RS232_RS485Config rs485;
+
+    RS232_RS485ConfigInit(&rs485);
+    if (RS232_PortSetRS485(port, &rs485) == -1)
+    {
+      RS232_PortClose(port);
+      return NULL;
+    }
+  }
+
+  _RS232_PortRegister(port);
+
+  return port;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PortClose(RS232_Port *port)
+{
+
+  if (port == NULL) return -1;
+
+  _RS232_PortUnregister(port);
+
+  RS232_RxBufferDestroy(port->rx);
+
+  int err = RS232_Close(port->fd);
+
+  pthread_mutex_destroy(&port->modem_lock);
+  free(port);
+
+  return err;
+}
+
+RS232_ADDAPI RS232_FD RS232_ADDCALL RS232_PortFD(const RS232_Port *port)
+{
+
+  return (port != NULL) ? port->fd : RS232_INVALID_FD;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PortGetBaudrate(const RS232_Port *port)
+{
+
+  return (port != NULL) ? port->baudrate : -1;
+}
+
+RS232_ADDAPI const char * RS232_ADDCALL RS232_PortGetMode(const RS232_Port *port)
+{
+
+  return (port != NULL) ? port->mode : NULL;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PortReconfigure(RS232_Port *port, int baudrate, const char *mode, int flags)
+{
+
+  if (port == NULL || mode == NULL || strlen(mode) != 3) return -1;
+
+  if (RS232_Reconfigure(port->fd, baudrate, mode, flags) != 0) return -1;
+
+  int actual = RS232_GetBaudrate(port->fd);
+  port->baudrate = (actual > 0) ? actual : baudrate;
+  memcpy(port->mode, mode, sizeof(port->mode));
+  port->flags = flags;
+
+  /* Reconfiguring may have changed RTS. */
+  pthread_mutex_lock(&port->modem_lock);
+  port->modem_shadow_valid = (_RS232_ModemShadowInit(port->fd, &port->modem_shadow) == 0);
+  pthread_mutex_unlock(&port->modem_lock);
+
+  return 0;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PortSetModemLines(RS232_Port *port, int set, int clear)
+{
+
+  if (port == NULL || ((set | clear) & ~(RS232_LINE_DTR | RS232_LINE_RTS)) != 0 || (set & clear) != 0) return -1;
+
+  pthread_mutex_lock(&port->modem_lock);
+  int err = port->modem_shadow_valid ? _RS232_ModemShadowApply(port->fd, &port->modem_shadow, set, clear)
+                                     : RS232_SetModemLines(port->fd, set, clear);
+  pthread_mutex_unlock(&port->modem_lock);
+
+  return err;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PortGetOutputLines(RS232_Port *port)
+{
+
+  if (port == NULL) return -1;
+
+  pthread_mutex_lock(&port->modem_lock);
+  int lines = port->modem_shadow_valid ? _RS232_ModemShadowLines(port->modem_shadow) : -1;
+  pthread_mutex_unlock(&port->modem_lock);
+
+  return lines;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PortSetRxBuffer(RS232_Port *port, size_t capacity)
+{
+
+  RS232_RxBuffer *rx = NULL;
+
+  if (port == NULL) return -1;
+
+  if (capacity > 0)
+  {
+    rx = RS232_RxBufferCreate(port->fd, capacity);
+    if (rx == NULL) return -1;
+    rx->stats = port->stats;
+  }
+
+  RS232_RxBufferDestroy(port->rx);
+  port->rx = rx;
+
+  return 0;
+}
+
+RS232_ADDAPI RS232_RxBuffer * RS232_ADDCALL RS232_PortRxBuffer(const RS232_Port *port)
+{
+
+  return (port != NULL) ? port->rx : NULL;
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_PortRead(RS232_Port *port, void *buf, size_t size, int flags, int timeout_msec)
+{
+
+  struct timespec deadline;
+
+  return RS232_PortReadUntil(port, buf, size, flags, _RS232_Deadline(&deadline, timeout_msec));
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_PortReadUntil(RS232_Port *port, void *buf, size_t size, int flags, const struct timespec *deadline)
+{
+
+  if (port == NULL) return -1;
+
+  if (port->rx != NULL) return _RS232_RxBufferRead(port->rx, buf, size, flags, deadline);
+
+  return _RS232_ReadUntil(port->stats, port->fd, buf, size, flags, deadline);
+}
+
+/*
+ * RS-485 without driver support: the direction is switched around the write. Called with the
+ * modem lock held for the whole transmission, so that nobody else touches RTS meanwhile.
+ */
+static ssize_t _RS232_PortWriteRS485(RS232_Port *port, const void *buf, size_t size, int flags, const struct timespec *deadline)
+{
+
+  const RS232_RS485Config *config = &port->rs485;
+  int send = config->rts_on_send ? RS232_LINE_RTS : 0;
+  int receive = config->rts_on_send ? 0 : RS232_LINE_RTS;
+
+  if (_RS232_ModemShadowApply(port->fd, &port->modem_shadow, send, receive) != 0) return -1;
+
+  if (config->delay_before_send_msec > 0) _RS232_SleepUsec(config->delay_before_send_msec * 1000LL);
+
+  ssize_t written_bytes = _RS232_WriteUntil(port->stats, port->fd, buf, size, flags, deadline);
+
+  /*
+   * Switching back early would cut off the last bits, so the drain may take the on-wire time of
+   * the bytes just written past the deadline, but not longer: flow control or a stuck adapter
+   * must not hold the modem lock forever. What could not be drained is discarded rather than
+   * sent with the direction switched back.
+   */
+  if (written_bytes > 0)
+  {
+    struct timespec drain_deadline;
+    const struct timespec *drain = NULL;
+
+    if (deadline != NULL)
+    {
+      int baudrate = RS232_GetBaudrate(port->fd);
+      long long char_usec = (baudrate > 0) ? 10 * 1000000LL / baudrate : 1000;
+
+      /* One character more for the transmit shift register. */
+      timespecadd_usec(deadline, (written_bytes + 1) * char_usec, &drain_deadline);
+      drain = &drain_deadline;
+    }
+
+    if (RS232_Drain(port->fd, drain) != 0)
+    {
+      RS232_flushTX(port->fd);
+      written_bytes = -1;
+    }
+  }
+
+  if (config->delay_after_send_msec > 0) _RS232_SleepUsec(config->delay_after_send_msec * 1000LL);
+
+  if (_RS232_ModemShadowApply(port->fd, &port->modem_shadow, receive, send) != 0) return -1;
+
+  return written_bytes;
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_PortWrite(RS232_Port *port, const void *buf, size_t size, int flags, int timeout_msec)
+{
+
+  struct timespec deadline_buf;
+  const struct timespec *deadline;
+
+  if (port == NULL) return -1;
+
+  deadline = _RS232_Deadline(&deadline_buf, timeout_msec);
+
+  if (port->rs485_software)
+  {
+    pthread_mutex_lock(&port->modem_lock);
+    ssize_t written_bytes = _RS232_PortWriteRS485(port, buf, size, flags, deadline);
+    pthread_mutex_unlock(&port->modem_lock);
+    return written_bytes;
+  }
+
+  return _RS232_WriteUntil(port->stats, port->fd, buf, size, flags, deadline);
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_PortWriteAsync(RS232_Port *port, const void *buf, size_t size)
+{
+
+  struct timespec deadline_buf;
+  int err = 0;
+
+  if (port == NULL) return -1;
+
+  if (port->rs485_software)
+  {
+    const RS232_RS485Config *config = &port->rs485;
+    int send = config->rts_on_send ? RS232_LINE_RTS : 0;
+    int receive = config->rts_on_send ? 0 : RS232_LINE_RTS;
+
+    pthread_mutex_lock(&port->modem_lock);
+
+    if (!port->rs485_async)
+    {
+      err = _RS232_ModemShadowApply(port->fd, &port->modem_shadow, send, receive);
+      if (err == 0)
+      {
+        port->rs485_async = true;
+        port->rs485_empty_seen = false;
+
+        /* The turnaround time of the transceiver, short and set by the application. */
+        if (config->delay_before_send_msec > 0) _RS232_SleepUsec(config->delay_before_send_msec * 1000LL);
+      }
+    }
+
+    pthread_mutex_unlock(&port->modem_lock);
+
+    if (err != 0) return -1;
+  }
+
+  return _RS232_WriteUntil(port->stats, port->fd, buf, size, 0, _RS232_Deadline(&deadline_buf, 0));
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PortWriteAsyncEnd(RS232_Port *port)
+{
+
+  struct timespec now, end;
+  int result = 1;
+
+  if (port == NULL) return -1;
+
+  pthread_mutex_lock(&port->modem_lock);
+
+  if (port->rs485_software && port->rs485_async)
+  {
+    const RS232_RS485Config *config = &port->rs485;
+    int send = config->rts_on_send ? RS232_LINE_RTS : 0;
+    int receive = config->rts_on_send ? 0 : RS232_LINE_RTS;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (!port->rs485_empty_seen)
+    {
+      int pending = RS232_BytesPending(port->fd);
+
+      /* Without transmitter status an empty output queue has to do, see the header. */
+      if (pending == -1)
+        result = -1;
+      else if (pending > 0 || _RS232_TransmitterEmpty(port->fd) == 0)
+        result = 0;
+      else
+      {
+        port->rs485_empty_seen = true;
+        port->rs485_empty_at = now;
+      }
+    }
+
+    if (result == 1)
+    {
+      timespecadd_usec(&port->rs485_empty_at, config->delay_after_send_msec * 1000LL, &end);
+      if (timespec_before(&now, &end)) result = 0;
+    }
+
+    if (result != 0)
+    {
+      if (_RS232_ModemShadowApply(port->fd, &port->modem_shadow, receive, send) != 0) result = -1;
+      port->rs485_async = false;
+    }
+  }
+
+  pthread_mutex_unlock(&port->modem_lock);
+
+  return result;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PortSetRS485(RS232_Port *port, const RS232_RS485Config *config)
+{
+
+  int result = 0;
+
+  if (port == NULL) return -1;
+
+  if (config != NULL && (config->delay_before_send_msec < 0 || config->delay_after_send_msec < 0)) return -1;
+
+  pthread_mutex_lock(&port->modem_lock);
+
+  if (port->rs485_software) port->rs485_software = false;
+  else if (config == NULL) RS232_SetRS485(port->fd, NULL);
+
+  if (config != NULL && RS232_SetRS485(port->fd, config) != 0)
+  {
+    if (!port->modem_shadow_valid)
+    {
+      result = -1; /* Software switching needs the shadow. */
+    }
+    else
+    {
+      int receive = config->rts_on_send ? 0 : RS232_LINE_RTS;
+      int send = config->rts_on_send ? RS232_LINE_RTS : 0;
+
+      port->rs485 = *config;
+      port->rs485_software = true;
+      result = (_RS232_ModemShadowApply(port->fd, &port->modem_shadow, receive, send) == 0) ? RS232_RS485_SOFTWARE : -1;
+      if (result == -1) port->rs485_software = false;
+    }
+  }
+
+  pthread_mutex_unlock(&port->modem_lock);
+
+  return result;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PortEnableStats(RS232_Port *port, int enable)
+{
+
+  if (port == NULL) return -1;
+
+#if WITH_RS232_STATS
+  port->stats = enable ? &port->stats_data : NULL;
+  if (port->rx != NULL) port->rx->stats = port->stats;
+#else
+  (void)enable;
+#endif
+
+  return 0;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PortGetStats(const RS232_Port *port, RS232_Stats *stats)
+{
+
+  if (port == NULL || stats == NULL) return -1;
+
+  /* All members are uint64_t. */
+  const uint64_t *src = (const uint64_t *)&port->stats_data;
+  uint64_t *dst = (uint64_t *)stats;
+
+  for (size_t i = 0; i < sizeof(*stats) / sizeof(uint64_t); i++)
+  {
+    dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+  }
+
+  return 0;
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_PortResetStats(RS232_Port *port)
+{
+
+  if (port == NULL) return;
+
+  uint64_t *counters = (uint64_t *)&port->stats_data;
+
+  for (size_t i = 0; i < sizeof(port->stats_data) / sizeof(uint64_t); i++)
+  {
+    __atomic_store_n(&counters[i], 0, __ATOMIC_RELAXED);
+  }
+}
+
+/* Computes the difference to the baseline, which is then moved forward. Counters wrap around. */
+static void _RS232_ICounterDelta(const RS232_ICounter *now, RS232_ICounter *baseline, RS232_ICounter *delta)
+{
+
+  delta->rx = now->rx - baseline->rx;
+  delta->tx = now->tx - baseline->tx;
+  delta->frame = now->frame - baseline->frame;
+  delta->overrun = now->overrun - baseline->overrun;
+  delta->parity = now->parity - baseline->parity;
+  delta->brk = now->brk - baseline->brk;
+  delta->buf_overrun = now->buf_overrun - baseline->buf_overrun;
+
+  *baseline = *now;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PortGetICounterDelta(RS232_Port *port, RS232_ICounter *delta)
+{
+
+  RS232_ICounter now;
+
+  if (port == NULL || delta == NULL) return -1;
+
+  if (RS232_GetICounter(port->fd, &now) != 0) return -1;
+
+  _RS232_ICounterDelta(&now, &port->icount_last, delta);
+
+  return 0;
+}
+
+struct RS232_ICounterMonitor
+{
+  int interval_msec;
+  RS232_ICounterCallback callback;
+  void *userdata;
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;
+  pthread_t thread;
+  bool stop;
+};
+
+static bool _RS232_ICounterMonitorRunning = false;  /* Protected by _RS232_PortsLock. */
+
+static void _RS232_ICounterMonitorSample(RS232_ICounterMonitor *monitor)
+{
+
+  RS232_ICounter now, delta;
+
+  /* Ports can't be closed while being sampled. */
+  pthread_mutex_lock(&_RS232_PortsLock);
+
+  for (RS232_Port *port = _RS232_Ports; port != NULL; port = port->next)
+  {
+    if (_RS232_GetICounter(port->fd, &now) != 0) continue;
+
+    _RS232_ICounterDelta(&now, &port->icount_monitor, &delta);
+    monitor->callback(port, &delta, monitor->userdata);
+  }
+
+  pthread_mutex_unlock(&_RS232_PortsLock);
+}
+
+static void *_RS232_ICounterMonitorThread(void *arg)
+{
+
+  RS232_ICounterMonitor *monitor = arg;
+  struct timespec deadline, remaining;
+
+  timespec_deadline_usec(&deadline, monitor->interval_msec * 1000LL);
+
+  pthread_mutex_lock(&monitor->lock);
+
+  while (!monitor->stop)
+  {
+    if (_RS232_CondWaitUntil(&monitor->wakeup, &monitor->lock, &deadline) != ETIMEDOUT) continue;
+
+    pthread_mutex_unlock(&monitor->lock);
+    _RS232_ICounterMonitorSample(monitor);
+    pthread_mutex_lock(&monitor->lock);
+
+    /* Fixed rate: the next sample is due one interval after the previous one was. */
+    timespecadd_usec(&deadline, monitor->interval_msec * 1000LL, &deadline);
+    if (!timespec_remaining(&deadline, &remaining)) timespec_deadline_usec(&deadline, monitor->interval_msec * 1000LL); /* Fallen behind. */
+  }
+
+  pthread_mutex_unlock(&monitor->lock);
+
+  return NULL;
+}
+
+RS232_ADDAPI RS232_ICounterMonitor * RS232_ADDCALL RS232_ICounterMonitorStart(int interval_msec, RS232_ICounterCallback callback, void *userdata)
+{
+
+  if (interval_msec <= 0 || callback == NULL) return NULL;
+
+  RS232_ICounterMonitor *monitor = calloc(1, sizeof(*monitor));
+  if (monitor == NULL) return NULL;
+
+  monitor->interval_msec = interval_msec;
+  monitor->callback = callback;
+  monitor->userdata = userdata;
+
+  pthread_mutex_lock(&_RS232_PortsLock);
+  if (_RS232_ICounterMonitorRunning)
+  {
+    pthread_mutex_unlock(&_RS232_PortsLock);
+    RS232_FPRINTF(stderr, "Counter monitor is already running.\n");
+    free(monitor);
+    return NULL;
+  }
+  _RS232_ICounterMonitorRunning = true;
+  pthread_mutex_unlock(&_RS232_PortsLock);
+
+  pthread_mutex_init(&monitor->lock, NULL);
+  _RS232_CondInit(&monitor->wakeup);
+
+  if (pthread_create(&monitor->thread, NULL, _RS232_ICounterMonitorThread, monitor) != 0)
+  {
+    RS232_FPRINTF(stderr, "Unable to start monitor thread.\n");
+    pthread_cond_destroy(&monitor->wakeup);
+    pthread_mutex_destroy(&monitor->lock);
+    free(monitor);
+
+    pthread_mutex_lock(&_RS232_PortsLock);
+    _RS232_ICounterMonitorRunning = false;
+    pthread_mutex_unlock(&_RS232_PortsLock);
+    return NULL;
+  }
+
+  return monitor;
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_ICounterMonitorStop(RS232_ICounterMonitor *monitor)
+{
+
+  if (monitor == NULL) return;
+
+  pthread_mutex_lock(&monitor->lock);
+  monitor->stop = true;
+  pthread_cond_signal(&monitor->wakeup);
+  pthread_mutex_unlock(&monitor->lock);
+
+  pthread_join(monitor->thread, NULL);
+
+  pthread_cond_destroy(&monitor->wakeup);
+  pthread_mutex_destroy(&monitor->lock);
+  free(monitor);
+
+  pthread_mutex_lock(&_RS232_PortsLock);
+  _RS232_ICounterMonitorRunning = false;
+  pthread_mutex_unlock(&_RS232_PortsLock);
+}
+
+#if WINDOWS_BUILD == 0
+
+#if defined(__linux__)
+
+/*
+ * https://man7.org/linux/man-pages/man7/epoll.7.html
+ */
+
+struct RS232_Poller
+{
+  int epfd;
+  void **userdata;              /* Indexed by file descriptor. */
+  int userdata_size;
+  struct epoll_event *ready;
+  int ready_size;
+};
+
+static int _RS232_PollerToEpoll(int events)
+{
+
+  int ev = 0;
+
+  if (events & RS232_POLL_IN) ev |= EPOLLIN;
+  if (events & RS232_POLL_OUT) ev |= EPOLLOUT;
+
+  return ev;
+}
+
+static int _RS232_PollerFromEpoll(int ev)
+{
+
+  int events = 0;
+
+  if (ev & EPOLLIN) events |= RS232_POLL_IN;
+  if (ev & EPOLLOUT) events |= RS232_POLL_OUT;
+  if (ev & (EPOLLERR | EPOLLHUP)) events |= RS232_POLL_ERR;
+
+  return events;
+}
+
+RS232_ADDAPI RS232_Poller * RS232_ADDCALL RS232_PollerCreate(void)
+{
+
+  RS232_Poller *poller = calloc(1, sizeof(*poller));
+  if (poller == NULL) return NULL;
+
+  poller->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (poller->epfd == -1)
+  {
+    RS232_PERROR("Unable to create epoll instance ");
+    free(poller);
+    return NULL;
+  }
+
+  return poller;
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_PollerDestroy(RS232_Poller *poller)
+{
+
+  if (poller == NULL) return;
+
+  close(poller->epfd);
+  free(poller->userdata);
+  free(poller->ready);
+  free(poller);
+}
+
+static int _RS232_PollerCtl(RS232_Poller *poller, int op, RS232_FD fd, int events, void *userdata)
+{
+
+  struct epoll_event ev = { 0 };
+
+  if (poller == NULL || fd < 0) return -1;
+
+  if (fd >= poller->userdata_size)
+  {
+    int size = poller->userdata_size ? poller->userdata_size : 64;
+    while (size <= fd) size *= 2;
+
+    void **ud = realloc(poller->userdata, size * sizeof(*ud));
+    if (ud == NULL) return -1;
+
+    memset(ud + poller->userdata_size, 0, (size - poller->userdata_size) * sizeof(*ud));
+    poller->userdata = ud;
+    poller->userdata_size = size;
+  }
+
+  ev.events = _RS232_PollerToEpoll(events);
+  ev.data.fd = fd;
+
+  if (epoll_ctl(poller->epfd, op, fd, &ev) == -1)
+  {
+    RS232_FPRINTF(stderr, "Error in epoll_ctl: %d.\n", errno);
+    return -1;
+  }
+
+  poller->userdata[fd] = userdata;
+
+  return 0;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PollerAdd(RS232_Poller *poller, RS232_FD fd, int events, void *userdata)
+{
+
+  return _RS232_PollerCtl(poller, EPOLL_CTL_ADD, fd, events, userdata);
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PollerModify(RS232_Poller *poller, RS232_FD fd, int events, void *userdata)
+{
+
+  return _RS232_PollerCtl(poller, EPOLL_CTL_MOD, fd, events, userdata);
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PollerRemove(RS232_Poller *poller, RS232_FD fd)
+{
+
+  if (poller == NULL || fd < 0 || fd >= poller->userdata_size) return -1;
+
+  if (epoll_ctl(poller->epfd, EPOLL_CTL_DEL, fd, NULL) == -1)
+  {
+    RS232_FPRINTF(stderr, "Error in epoll_ctl: %d.\n", errno);
+    return -1;
+  }
+
+  poller->userdata[fd] = NULL;
+
+  return 0;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PollerWait(RS232_Poller *poller, RS232_PollEvent *events, int max_events, int timeout_msec)
+{
+
+  int fdcount;
+
+  if (poller == NULL || events == NULL || max_events <= 0) return -1;
+
+  if (max_events > poller->ready_size)
+  {
+    struct epoll_event *ready = realloc(poller->ready, max_events * sizeof(*ready));
+    if (ready == NULL) return -1;
+
+    poller->ready = ready;
+    poller->ready_size = max_events;
+  }
+
+  fdcount = epoll_wait(poller->epfd, poller->ready, max_events, timeout_msec);
+  if (fdcount == -1)
+  {
+    if (errno == EINTR) return 0;
+    RS232_FPRINTF(stderr, "Error in epoll_wait: %d.\n", errno);
+    return -1;
+  }
+
+  for (int i = 0; i < fdcount; i++)
+  {
+    int fd = poller->ready[i].data.fd;
+
+    events[i].fd = fd;
+    events[i].events = _RS232_PollerFromEpoll(poller->ready[i].events);
+    events[i].userdata = poller->userdata[fd];
+  }
+
+  return fdcount;
+}
+
+#else  /* Other POSIX systems */
+
+/*
+ * https://pubs.opengroup.org/onlinepubs/9699919799/functions/poll.html
+ */
+
+struct RS232_Poller
+{
+  struct pollfd *pfds;
+  void **userdata;              /* Same index as pfds. */
+  int count;
+  int size;
+};
+
+static short _RS232_PollerToPoll(int events)
+{
+
+  short ev = 0;
+
+  if (events & RS232_POLL_IN) ev |= POLLIN;
+  if (events & RS232_POLL_OUT) ev |= POLLOUT;
+
+  return ev;
+}
+
+static int _RS232_PollerFromPoll(short ev)
+{
+
+  int events = 0;
+
+  if (ev & POLLIN) events |= RS232_POLL_IN;
+  if (ev & POLLOUT) events |= RS232_POLL_OUT;
+  if (ev & (POLLERR | POLLHUP | POLLNVAL)) events |= RS232_POLL_ERR;
+
+  return events;
+}
+
+static int _RS232_PollerFind(const RS232_Poller *poller, RS232_FD fd)
+{
+
+  for (int i = 0; i < poller->count; i++)
+  {
+    if (poller->pfds[i].fd == fd) return i;
+  }
+
+  return -1;
+}
+
+RS232_ADDAPI RS232_Poller * RS232_ADDCALL RS232_PollerCreate(void)
+{
+
+  return calloc(1, sizeof(RS232_Poller));
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_PollerDestroy(RS232_Poller *poller)
+{
+
+  if (poller == NULL) return;
+
+  free(poller->pfds);
+  free(poller->userdata);
+  free(poller);
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PollerAdd(RS232_Poller *poller, RS232_FD fd, int events, void *userdata)
+{
+
+  if (poller == NULL || fd < 0 || _RS232_PollerFind(poller, fd) != -1) return -1;
+
+  if (poller->count == poller->size)
+  {
+    int size = poller->size ? poller->size * 2 : 64;
+
+    struct pollfd *pfds = realloc(poller->pfds, size * sizeof(*pfds));
+    if (pfds == NULL) return -1;
+    poller->pfds = pfds;
+
+    void **ud = realloc(poller->userdata, size * sizeof(*ud));
+    if (ud == NULL) return -1;
+    poller->userdata = ud;
+
+    poller->size = size;
+  }
+
+  poller->pfds[poller->count].fd = fd;
+  poller->pfds[poller->count].events = _RS232_PollerToPoll(events);
+  poller->pfds[poller->count].revents = 0;
+  poller->userdata[poller->count] = userdata;
+  poller->count++;
+
+  return 0;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PollerModify(RS232_Poller *poller, RS232_FD fd, int events, void *userdata)
+{
+
+  if (poller == NULL) return -1;
+
+  int i = _RS232_PollerFind(poller, fd);
+  if (i == -1) return -1;
+
+  poller->pfds[i].events = _RS232_PollerToPoll(events);
+  poller->userdata[i] = userdata;
+
+  return 0;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PollerRemove(RS232_Poller *poller, RS232_FD fd)
+{
+
+  if (poller == NULL) return -1;
+
+  int i = _RS232_PollerFind(poller, fd);
+  if (i == -1) return -1;
+
+  poller->count--;
+  poller->pfds[i] = poller->pfds[poller->count];
+  poller->userdata[i] = poller->userdata[poller->count];
+
+  return 0;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PollerWait(RS232_Poller *poller, RS232_PollEvent *events, int max_events, int timeout_msec)
+{
+
+  int fdcount, n = 0;
+
+  if (poller == NULL || events == NULL || max_events <= 0) return -1;
+
+  fdcount = poll(poller->pfds, poller->count, timeout_msec);
+  if (fdcount == -1)
+  {
+    if (errno == EINTR) return 0;
+    RS232_FPRINTF(stderr, "Error in poll: %d.\n", errno);
+    return -1;
+  }
+
+  for (int i = 0; i < poller->count && n < fdcount && n < max_events; i++)
+  {
+    if (poller->pfds[i].revents == 0) continue;
+
+    events[n].fd = poller->pfds[i].fd;
+    events[n].events = _RS232_PollerFromPoll(poller->pfds[i].revents);
+    events[n].userdata = poller->userdata[i];
+    n++;
+  }
+
+  return n;
+}
+
+#endif
+
+#else  /* Windows */
+
+RS232_ADDAPI RS232_Poller * RS232_ADDCALL RS232_PollerCreate(void)
+{
+
+  RS232_FPRINTF(stderr, "Poller is not supported on Windows.\n");
+  return NULL;
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_PollerDestroy(RS232_Poller *poller)
+{
+
+  (void)poller;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PollerAdd(RS232_Poller *poller, RS232_FD fd, int events, void *userdata)
+{
+
+  (void)poller; (void)fd; (void)events; (void)userdata;
+  return -1;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PollerModify(RS232_Poller *poller, RS232_FD fd, int events, void *userdata)
+{
+
+  (void)poller; (void)fd; (void)events; (void)userdata;
+  return -1;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PollerRemove(RS232_Poller *poller, RS232_FD fd)
+{
+
+  (void)poller; (void)fd;
+  return -1;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_PollerWait(RS232_Poller *poller, RS232_PollEvent *events, int max_events, int timeout_msec)
+{
+
+  (void)poller; (void)events; (void)max_events; (void)timeout_msec;
+  return -1;
+}
+
+#endif
+
+#if WINDOWS_BUILD == 0 && defined(__linux__) && WITH_RS232_IO_URING
+
+/*
+ * The ring is driven by the raw system calls, so liburing is not needed. A request is a chain of
+ * up to three SQEs: a poll linked to the read or write, the poll optionally followed by a linked
+ * timeout. The poll is needed because the file descriptor is non-blocking and a plain read would
+ * complete with EAGAIN right away. The request is reported once all of its CQEs have arrived.
+ */
+
+enum
+{
+  _RS232_URING_POLL = 0,
+  _RS232_URING_TIMEOUT = 1,
+  _RS232_URING_IO = 2,
+};
+
+typedef struct
+{
+  RS232_FD fd;
+  void *userdata;
+  struct __kernel_timespec timeout;   /* Read by the kernel on submission. */
+  int pending;                        /* CQEs still to come. */
+  int poll_error;
+  int io_result;
+  int next_free;
+} _RS232_UringRequest;
+
+struct RS232_Uring
+{
+  int ring_fd;
+  void *ring;
+  size_t ring_size;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  unsigned *sq_head, *sq_tail, *sq_array, sq_mask, sq_entries;
+  unsigned *cq_head, *cq_tail, cq_mask;
+  struct io_uring_cqe *cqes;
+  unsigned sq_local_tail;
+  unsigned to_submit;
+  _RS232_UringRequest *requests;
+  int free_request;
+};
+
+static int _RS232_UringSetup(unsigned entries, struct io_uring_params *params)
+{
+
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int _RS232_UringEnter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz)
+{
+
+  return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+RS232_ADDAPI RS232_Uring * RS232_ADDCALL RS232_UringCreate(unsigned max_requests)
+{
+
+  struct io_uring_params params;
+  const unsigned needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP;
+
+  if (max_requests == 0) return NULL;
+
+  RS232_Uring *uring = calloc(1, sizeof(*uring));
+  if (uring == NULL) return NULL;
+
+  uring->requests = calloc(max_requests, sizeof(*uring->requests));
+  if (uring->requests == NULL)
+  {
+    free(uring);
+    return NULL;
+  }
+
+  memset(&params, 0, sizeof(params));
+
+  uring->ring_fd = _RS232_UringSetup(3 * max_requests, &params);
+  if (uring->ring_fd == -1)
+  {
+    RS232_PERROR("io_uring is not available ");
+    free(uring->requests);
+    free(uring);
+    return NULL;
+  }
+
+  if ((params.features & needed) != needed)
+  {
+    RS232_FPRINTF(stderr, "io_uring is too old.\n");
+    close(uring->ring_fd);
+    free(uring->requests);
+    free(uring);
+    return NULL;
+  }
+
+  /* Submission and completion ring share one mapping. */
+  size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+  uring->ring_size = (sq_size > cq_size) ? sq_size : cq_size;
+  uring->ring = mmap(NULL, uring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_SQ_RING);
+
+  uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_SQES);
+
+  if (uring->ring == MAP_FAILED || uring->sqes == MAP_FAILED)
+  {
+    RS232_PERROR("Unable to map io_uring ");
+    if (uring->ring != MAP_FAILED) munmap(uring->ring, uring->ring_size);
+    if (uring->sqes != MAP_FAILED) munmap(uring->sqes, uring->sqes_size);
+    close(uring->ring_fd);
+    free(uring->requests);
+    free(uring);
+    return NULL;
+  }
+
+  uint8_t *ring = uring->ring;
+
+  uring->sq_head = (unsigned *)(ring + params.sq_off.head);
+  uring->sq_tail = (unsigned *)(ring + params.sq_off.tail);
+  uring->sq_array = (unsigned *)(ring + params.sq_off.array);
+  uring->sq_mask = *(unsigned *)(ring + params.sq_off.ring_mask);
+  uring->sq_entries = params.sq_entries;
+  uring->cq_head = (unsigned *)(ring + params.cq_off.head);
+  uring->cq_tail = (unsigned *)(ring + params.cq_off.tail);
+  uring->cq_mask = *(unsigned *)(ring + params.cq_off.ring_mask);
+  uring->cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+  uring->sq_local_tail = *uring->sq_tail;
+
+  for (unsigned i = 0; i < max_requests; i++)
+  {
+    uring->requests[i].next_free = (i + 1 < max_requests) ? (int)(i + 1) : -1;
+  }
+  uring->free_request = 0;
+
+  return uring;
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_UringDestroy(RS232_Uring *uring)
+{
+
+  if (uring == NULL) return;
+
+  munmap(uring->sqes, uring->sqes_size);
+  munmap(uring->ring, uring->ring_size);
+  close(uring->ring_fd);  /* Cancels requests in flight. */
+  free(uring->requests);
+  free(uring);
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_UringRegisterBuffers(RS232_Uring *uring, const RS232_IOVec *iov, int iovcnt)
+{
+
+  if (uring == NULL || iov == NULL || iovcnt <= 0) return -1;
+
+  if (syscall(__NR_io_uring_register, uring->ring_fd, IORING_REGISTER_BUFFERS, iov, (unsigned)iovcnt) == -1)
+  {
+    RS232_PERROR("Unable to register buffers ");
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Takes the next free SQE, the caller has checked there is room. */
+static struct io_uring_sqe *_RS232_UringSqe(RS232_Uring *uring, int index, int kind)
+{
+
+  unsigned slot = uring->sq_local_tail & uring->sq_mask;
+  struct io_uring_sqe *sqe = &uring->sqes[slot];
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->user_data = ((uint64_t)index << 2) | (uint64_t)kind;
+
+  uring->sq_array[slot] = slot;
+  uring->sq_local_tail++;
+  uring->to_submit++;
+
+  return sqe;
+}
+
+static int _RS232_UringPrep(RS232_Uring *uring, RS232_FD fd, void *buf, size_t size, int buf_index,
+                            int timeout_msec, void *userdata, bool write_op)
+{
+
+  if (uring == NULL || (buf == NULL && size > 0) || size > UINT_MAX || timeout_msec < 0) return -1;
+
+  unsigned sq_used = uring->sq_local_tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+  int index = uring->free_request;
+
+  if (index == -1 || uring->sq_entries - sq_used < 3) return -1; /* Too many requests in flight. */
+
+  _RS232_UringRequest *req = &uring->requests[index];
+  uring->free_request = req->next_free;
+
+  req->fd = fd;
+  req->userdata = userdata;
+  req->pending = (timeout_msec == INT_MAX) ? 2 : 3;
+  req->poll_error = 0;
+  req->io_result = 0;
+
+  struct io_uring_sqe *sqe = _RS232_UringSqe(uring, index, _RS232_URING_POLL);
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = write_op ? POLLOUT : POLLIN;
+  sqe->flags = IOSQE_IO_LINK;
+
+  if (timeout_msec != INT_MAX)
+  {
+    req->timeout.tv_sec = timeout_msec / 1000;
+    req->timeout.tv_nsec = (long long)(timeout_msec % 1000) * 1000000LL;
+
+    sqe = _RS232_UringSqe(uring, index, _RS232_URING_TIMEOUT);
+    sqe->opcode = IORING_OP_LINK_TIMEOUT;
+    sqe->addr = (uint64_t)(uintptr_t)&req->timeout;
+    sqe->len = 1;
+    sqe->flags = IOSQE_IO_LINK;
+  }
+
+  sqe = _RS232_UringSqe(uring, index, _RS232_URING_IO);
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)buf;
+  sqe->len = (unsigned)size;
+
+  if (buf_index >= 0)
+  {
+    sqe->opcode = write_op ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+    sqe->buf_index = (uint16_t)buf_index;
+  }
+  else
+  {
+    sqe->opcode = write_op ? IORING_OP_WRITE : IORING_OP_READ;
+  }
+
+  __atomic_store_n(uring->sq_tail, uring->sq_local_tail, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_UringPrepRead(RS232_Uring *uring, RS232_FD fd, void *buf, size_t size, int buf_index,
+                                                  int timeout_msec, void *userdata)
+{
+
+  return _RS232_UringPrep(uring, fd, buf, size, buf_index, timeout_msec, userdata, false);
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_UringPrepWrite(RS232_Uring *uring, RS232_FD fd, const void *buf, size_t size, int buf_index,
+                                                   int timeout_msec, void *userdata)
+{
+
+  return _RS232_UringPrep(uring, fd, (void *)buf, size, buf_index, timeout_msec, userdata, true);
+}
+
+/* Processes CQEs until max_completions requests are complete or the ring is empty. */
+static int _RS232_UringReap(RS232_Uring *uring, RS232_UringCompletion *completions, int max_completions)
+{
+
+  int count = 0;
+  unsigned head = *uring->cq_head;
+
+  while (count < max_completions && head != __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE))
+  {
+    const struct io_uring_cqe *cqe = &uring->cqes[head & uring->cq_mask];
+    int index = (int)(cqe->user_data >> 2);
+    int kind = (int)(cqe->user_data & 3);
+    _RS232_UringRequest *req = &uring->requests[index];
+
+    head++;
+
+    if (kind == _RS232_URING_POLL && cqe->res < 0 && cqe->res != -ECANCELED)
+      req->poll_error = -cqe->res;
+    else if (kind == _RS232_URING_IO)
+      req->io_result = cqe->res;
+
+    if (--req->pending > 0) continue;
+
+    RS232_UringCompletion *completion = &completions[count++];
+
+    completion->fd = req->fd;
+    completion->userdata = req->userdata;
+    completion->error = 0;
+
+    if (req->io_result >= 0)
+    {
+      completion->result = req->io_result;
+    }
+    else if (req->io_result == -ECANCELED && req->poll_error == 0)
+    {
+      completion->result = 0; /* The linked timeout has cancelled the chain. */
+    }
+    else
+    {
+      completion->result = -1;
+      completion->error = (req->poll_error != 0) ? req->poll_error : -req->io_result;
+    }
+
+    req->next_free = uring->free_request;
+    uring->free_request = index;
+  }
+
+  __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+
+  return count;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_UringSubmit(RS232_Uring *uring, RS232_UringCompletion *completions, int max_completions, int timeout_msec)
+{
+
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  struct timespec deadline_buf, remaining;
+  const struct timespec *deadline = _RS232_Deadline(&deadline_buf, timeout_msec);
+  int count;
+
+  if (uring == NULL || completions == NULL || max_completions <= 0 || timeout_msec < 0) return -1;
+
+  count = _RS232_UringReap(uring, completions, max_completions);
+
+  /* Poll and timeout CQEs wake us up too, so wait again until a request has completed. */
+  for (;;)
+  {
+    unsigned min_complete = (count == 0 && timeout_msec != 0) ? 1 : 0;
+
+    if (uring->to_submit == 0 && min_complete == 0) break;
+
+    memset(&arg, 0, sizeof(arg));
+    if (deadline != NULL)
+    {
+      if (!timespec_remaining(deadline, &remaining)) min_complete = 0; /* Time is up, submit only. */
+
+      ts.tv_sec = remaining.tv_sec;
+      ts.tv_nsec = remaining.tv_nsec;
+      arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+
+    int ret = _RS232_UringEnter(uring->ring_fd, uring->to_submit, min_complete,
+                                IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+
+    if (ret >= 0)
+    {
+      uring->to_submit -= (unsigned)ret;
+    }
+    else if (errno != ETIME && errno != EINTR)
+    {
+      RS232_PERROR("Unable to submit ");
+      return (count > 0) ? count : -1;
+    }
+
+    count += _RS232_UringReap(uring, completions + count, max_completions - count);
+
+    if (min_complete == 0 || (ret < 0 && errno == ETIME)) break;
+  }
+
+  return count;
+}
+
+#else
+
+RS232_ADDAPI RS232_Uring * RS232_ADDCALL RS232_UringCreate(unsigned max_requests)
+{
+
+  (void)max_requests;
+  return NULL;
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_UringDestroy(RS232_Uring *uring)
+{
+
+  (void)uring;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_UringRegisterBuffers(RS232_Uring *uring, const RS232_IOVec *iov, int iovcnt)
+{
+
+  (void)uring; (void)iov; (void)iovcnt;
+  return -1;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_UringPrepRead(RS232_Uring *uring, RS232_FD fd, void *buf, size_t size, int buf_index,
+                                                  int timeout_msec, void *userdata)
+{
+
+  (void)uring; (void)fd; (void)buf; (void)size; (void)buf_index; (void)timeout_msec; (void)userdata;
+  return -1;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_UringPrepWrite(RS232_Uring *uring, RS232_FD fd, const void *buf, size_t size, int buf_index,
+                                                   int timeout_msec, void *userdata)
+{
+
+  (void)uring; (void)fd; (void)buf; (void)size; (void)buf_index; (void)timeout_msec; (void)userdata;
+  return -1;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_UringSubmit(RS232_Uring *uring, RS232_UringCompletion *completions, int max_completions, int timeout_msec)
+{
+
+  (void)uring; (void)completions; (void)max_completions; (void)timeout_msec;
+  return -1;
+}
+
+#endif
+
+#if WINDOWS_BUILD == 0 && defined(__linux__) && defined(TIOCMIWAIT)
+
+#include <signal.h>
+
+struct RS232_LineWatcher
+{
+  RS232_FD fd;
+  int lines;
+  RS232_LineCallback callback;
+  void *userdata;
+  int signo;
+  pthread_t thread;
+  int modem_lines;            /* State and counters at start, owned by the thread afterwards. */
+  int counters[4];
+  int stop;
+  int stopped;
+  int waiting;                /* Inside TIOCMIWAIT or about to enter it, the only time signo is sent. */
+  bool self_stop;             /* Stopped from the callback, the thread frees the watcher. */
+};
+
+/* Handlers replaced by the wakeup signals, chained to. */
+static pthread_mutex_t _RS232_LineWatcherSignalLock = PTHREAD_MUTEX_INITIALIZER;
+static struct sigaction _RS232_LineWatcherPrevious[NSIG];
+static bool _RS232_LineWatcherInstalled[NSIG];
+
+static void _RS232_LineWatcherSignal(int sig, siginfo_t *info, void *context)
+{
+
+  const struct sigaction *prev = &_RS232_LineWatcherPrevious[sig];
+
+  /* The default action is not taken, a signal ignored by default or a real-time signal is the right choice. */
+  if (prev->sa_flags & SA_SIGINFO)
+  {
+    if (prev->sa_sigaction != NULL) prev->sa_sigaction(sig, info, context);
+  }
+  else if (prev->sa_handler != SIG_DFL && prev->sa_handler != SIG_IGN)
+  {
+    prev->sa_handler(sig);
+  }
+}
+
+/* No SA_RESTART, so the signal makes TIOCMIWAIT fail with EINTR. */
+static int _RS232_LineWatcherInstallSignal(int signo)
+{
+
+  struct sigaction sa;
+  int result = 0;
+
+  if (signo <= 0 || signo >= NSIG) return -1;
+
+  pthread_mutex_lock(&_RS232_LineWatcherSignalLock);
+
+  if (!_RS232_LineWatcherInstalled[signo])
+  {
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = _RS232_LineWatcherSignal;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+
+    result = sigaction(signo, &sa, &_RS232_LineWatcherPrevious[signo]);
+    if (result == 0) _RS232_LineWatcherInstalled[signo] = true;
+  }
+
+  pthread_mutex_unlock(&_RS232_LineWatcherSignalLock);
+
+  return result;
+}
+
+/* Gets the transition counters of the input lines, which also catch pulses too short to be seen by TIOCMGET. */
+static int _RS232_LineCounters(RS232_FD fd, int counters[4])
+{
+
+  struct serial_icounter_struct icount;
+
+  if (ioctl(fd, TIOCGICOUNT, &icount) == -1) return -1;
+
+  counters[0] = icount.cts;
+  counters[1] = icount.dsr;
+  counters[2] = icount.dcd;
+  counters[3] = icount.rng;
+
+  return 0;
+}
+
+static void *_RS232_LineWatcherThread(void *arg)
+{
+
+  RS232_LineWatcher *watcher = arg;
+  const int line_bits[4] = { RS232_LINE_CTS, RS232_LINE_DSR, RS232_LINE_DCD, RS232_LINE_RI };
+  int mask = _RS232_LinesToTIOCM(watcher->lines);
+  int new_counters[4];
+  RS232_LineEvent event;
+
+  event.fd = watcher->fd;
+
+  while (!__atomic_load_n(&watcher->stop, __ATOMIC_ACQUIRE))
+  {
+    /* Transitions during the callback or before the wait has been entered are seen by the counters. */
+    if (_RS232_LineCounters(watcher->fd, new_counters) == -1)
+    {
+      RS232_PERROR("Unable to get modem line counters ");
+      break;
+    }
+
+    event.changed = 0;
+    for (int i = 0; i < 4; i++)
+    {
+      if (new_counters[i] != watcher->counters[i]) event.changed |= line_bits[i] & watcher->lines;
+    }
+
+    if (event.changed == 0)
+    {
+      int err = 0;
+
+      /* The stop flag is checked after announcing the wait, a later stop keeps signalling until the thread is out. */
+      __atomic_store_n(&watcher->waiting, 1, __ATOMIC_SEQ_CST);
+      if (!__atomic_load_n(&watcher->stop, __ATOMIC_SEQ_CST)) err = ioctl(watcher->fd, TIOCMIWAIT, mask);
+      __atomic_store_n(&watcher->waiting, 0, __ATOMIC_SEQ_CST);
+
+      if (err == -1 && errno != EINTR)
+      {
+        RS232_PERROR("Unable to wait for modem lines ");
+        break;
+      }
+      continue;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &event.timestamp);
+
+    event.lines = RS232_GetModemLines(watcher->fd);
+    if (event.lines == -1) break;
+
+    event.changed |= (event.lines ^ watcher->modem_lines) & watcher->lines;
+
+    memcpy(watcher->counters, new_counters, sizeof(new_counters));
+    watcher->modem_lines = event.lines;
+
+    watcher->callback(&event, watcher->userdata);
+  }
+
+  if (watcher->self_stop)
+  {
+    pthread_detach(pthread_self());
+    free(watcher);
+    return NULL;
+  }
+
+  __atomic_store_n(&watcher->stopped, 1, __ATOMIC_RELEASE);
+
+  return NULL;
+}
+
+RS232_ADDAPI RS232_LineWatcher * RS232_ADDCALL RS232_LineWatcherStart(RS232_FD fd, int lines, RS232_LineCallback callback, void *userdata, int signo)
+{
+
+  const int inputs = RS232_LINE_CTS | RS232_LINE_DSR | RS232_LINE_DCD | RS232_LINE_RI;
+
+  if (callback == NULL || (lines & inputs) == 0 || (lines & ~inputs) != 0 || signo <= 0 || signo >= NSIG) return NULL;
+
+  RS232_LineWatcher *watcher = calloc(1, sizeof(*watcher));
+  if (watcher == NULL) return NULL;
+
+  watcher->fd = fd;
+  watcher->lines = lines;
+  watcher->callback = callback;
+  watcher->userdata = userdata;
+  watcher->signo = signo;
+
+  /* Drivers implementing TIOCMIWAIT also implement TIOCGICOUNT, which unlike the former does not block. */
+  watcher->modem_lines = RS232_GetModemLines(fd);
+  if (watcher->modem_lines == -1 || _RS232_LineCounters(fd, watcher->counters) == -1)
+  {
+    RS232_FPRINTF(stderr, "Modem line transitions can not be watched on this device.\n");
+    free(watcher);
+    return NULL;
+  }
+
+  if (_RS232_LineWatcherInstallSignal(signo) != 0)
+  {
+    RS232_PERROR("Unable to install the watcher signal handler ");
+    free(watcher);
+    return NULL;
+  }
+
+  if (pthread_create(&watcher->thread, NULL, _RS232_LineWatcherThread, watcher) != 0)
+  {
+    RS232_FPRINTF(stderr, "Unable to start watcher thread.\n");
+    free(watcher);
+    return NULL;
+  }
+
+  return watcher;
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_LineWatcherStop(RS232_LineWatcher *watcher)
+{
+
+  if (watcher == NULL) return;
+
+  __atomic_store_n(&watcher->stop, 1, __ATOMIC_SEQ_CST);
+
+  /* Called from the callback: the thread ends once it returns and cleans up itself. */
+  if (pthread_equal(pthread_self(), watcher->thread))
+  {
+    watcher->self_stop = true;
+    return;
+  }
+
+  /* Only while waiting, the callback's system calls are not interrupted. Repeated, a signal
+     arriving right before the thread enters TIOCMIWAIT would be lost. */
+  while (!__atomic_load_n(&watcher->stopped, __ATOMIC_ACQUIRE))
+  {
+    if (__atomic_load_n(&watcher->waiting, __ATOMIC_SEQ_CST)) pthread_kill(watcher->thread, watcher->signo);
+    _RS232_SleepUsec(1000);
+  }
+
+  pthread_join(watcher->thread, NULL);
+
+  free(watcher);
+}
+
+#else
+
+RS232_ADDAPI RS232_LineWatcher * RS232_ADDCALL RS232_LineWatcherStart(RS232_FD fd, int lines, RS232_LineCallback callback, void *userdata, int signo)
+{
+
+  (void)fd; (void)lines; (void)callback; (void)userdata; (void)signo;
+  RS232_FPRINTF(stderr, "Line watcher is not supported on this platform.\n");
+  return NULL;
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_LineWatcherStop(RS232_LineWatcher *watcher)
+{
+
+  (void)watcher;
+}
+
+#endif
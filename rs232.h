@@ -35,15 +35,36 @@
 #define RS232_H_INCLUDED
 
 #include <stddef.h>
+#include <stdint.h>
 #include "rs232_platform.h"
 
 #ifndef WITH_RS232_LOCK
 #define WITH_RS232_LOCK  1
 #endif
 
+#ifndef WITH_RS232_STATS
+#define WITH_RS232_STATS  1  /* Per-port counters, see RS232_PortEnableStats. */
+#endif
+
+#ifndef WITH_RS232_IO_URING
+#define WITH_RS232_IO_URING  0  /* Linux only: io_uring backend, see RS232_UringCreate. */
+#endif
+
 /** Hardware flow control is enabled using the RTS/CTS lines. */
 #define RS232_FLAGS_HWFLOWCTRL  (1 << 0)
 
+/** RS232_Read returns as soon as some data has been received instead of waiting for the full size. */
+#define RS232_FLAGS_READSOME    (1 << 1)
+
+/** RS232_Read lets the kernel do the waiting in a blocking read() with VMIN/VTIME derived from size and timeout, instead of poll() and read(). */
+#define RS232_FLAGS_KERNELTIMEOUT  (1 << 2)
+
+/** RS232_Reconfigure waits until all data written has been transmitted before changing the settings. */
+#define RS232_FLAGS_DRAIN       (1 << 3)
+
+/** RS232_PortOpen switches to RS-485 half-duplex mode with the settings of RS232_RS485ConfigInit. */
+#define RS232_FLAGS_RS485       (1 << 4)
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -55,17 +76,125 @@ extern "C" {
  * @param[in] devname Serial interface device like /dev/ttyUSB0 on Linux or COM1 on Windows.
  *            Use \\.\COM10 on Windows for all interfaces number abobe COM9.
  * 
- * @param[in] baudrate expressed in baud per second i.e 115200
+ * @param[in] baudrate expressed in baud per second i.e 115200. On Linux any baudrate the
+ *            hardware supports can be used, check RS232_GetBaudrate for the one actually set.
  * 
  * @param[in] mode is a string in the form of "8N1", "7O2", "8E1", etc.
  * 
  * @param[in] flags can be combined using the bit-wise OR operator.
  *            At the moment only RS232_FLAGS_HWFLOWCTRL flag is supported.
  * 
+ * @note Retries up to 15 times, one second apart, if the interface can't be opened.
+ *       Use RS232_OpenEx for a different retry policy.
+ * 
  * @return File descriptor or RS232_INVALID_FD if something went wrong while opening interface.
  */
 RS232_ADDAPI RS232_FD RS232_ADDCALL RS232_Open(const char *devname, int baudrate, const char *mode, int flags);
 
+/** Retry policy of RS232_OpenEx and RS232_OpenAsync. */
+typedef struct
+{
+  int max_attempts;           /**< Maximal number of open attempts. 1: fail fast without retrying. */
+  int retry_delay_msec;       /**< Delay before the first retry in milliseconds. */
+  int max_retry_delay_msec;   /**< Upper bound of the delay between retries in milliseconds. */
+  int backoff_percent;        /**< Each delay is this percentage of the previous one. 100: constant, 200: doubling. */
+  int timeout_msec;           /**< Overall deadline of all attempts in milliseconds. INT_MAX: no deadline. */
+  int retry_missing;          /**< 1: retry also if the device doesn't exist or access is denied (yet). 0: fail fast. */
+} RS232_OpenOptions;
+
+/**
+ * @brief Called by RS232_OpenAsync once the serial interface has been opened or all attempts failed.
+ *
+ * @param[in] fd file descriptor or RS232_INVALID_FD if the serial interface couldn't be opened.
+ *
+ * @param[in] userdata given to RS232_OpenAsync.
+ */
+typedef void (*RS232_OpenCallback)(RS232_FD fd, void *userdata);
+
+/**
+ * @brief Initializes options with the retry policy of RS232_Open:
+ *        up to 16 attempts, one second apart, no overall deadline, missing devices retried.
+ *
+ * @param[out] options to initialize.
+ *
+ * @return 0 on success or -1 if options is NULL.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_OpenOptionsInit(RS232_OpenOptions *options);
+
+/**
+ * @brief Opens the serial interface like RS232_Open but with a configurable retry policy.
+ *        Invalid arguments (NULL device, bad baudrate or mode) are never retried.
+ *
+ * @param[in] devname, baudrate, mode, flags are the same as for RS232_Open.
+ *
+ * @param[in] options retry policy or NULL for the one of RS232_Open.
+ *
+ * @return File descriptor or RS232_INVALID_FD if something went wrong while opening interface.
+ */
+RS232_ADDAPI RS232_FD RS232_ADDCALL RS232_OpenEx(const char *devname, int baudrate, const char *mode, int flags, const RS232_OpenOptions *options);
+
+/**
+ * @brief Opens the serial interface in a background thread, the caller doesn't wait for retries.
+ *
+ * @param[in] devname, baudrate, mode, flags are the same as for RS232_Open.
+ *
+ * @param[in] options retry policy or NULL for the one of RS232_Open.
+ *
+ * @param[in] callback is called from the background thread once done.
+ *
+ * @param[in] userdata is passed to callback.
+ *
+ * @return 0 if the open has been started or -1 otherwise. On success the callback is always called.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_OpenAsync(const char *devname, int baudrate, const char *mode, int flags, const RS232_OpenOptions *options,
+                                              RS232_OpenCallback callback, void *userdata);
+
+/** Serial interface to be opened by RS232_OpenMany. */
+typedef struct
+{
+  const char *devname;        /**< Same as for RS232_Open. */
+  int baudrate;               /**< Same as for RS232_Open. */
+  const char *mode;           /**< Same as for RS232_Open. */
+  int flags;                  /**< Same as for RS232_Open. */
+  RS232_FD fd;                /**< Result: file descriptor or RS232_INVALID_FD. */
+  int error;                  /**< Result: errno (GetLastError on Windows) of the failed open, 0 on success. */
+} RS232_OpenSpec;
+
+/**
+ * @brief Opens many serial interfaces concurrently on a bounded pool of threads,
+ *        so that the time taken is set by the slowest interface rather than the sum of all.
+ *
+ * @param[in,out] specs are the serial interfaces to open. fd and error are filled in for every entry.
+ *
+ * @param[in] count is the number of entries in specs.
+ *
+ * @param[in] max_workers is the maximal number of threads used including the calling one, <= 0: 16.
+ *
+ * @param[in] options retry policy applied to every interface or NULL for the one of RS232_Open.
+ *
+ * @return Number of serial interfaces opened successfully.
+ */
+RS232_ADDAPI size_t RS232_ADDCALL RS232_OpenMany(RS232_OpenSpec *specs, size_t count, int max_workers, const RS232_OpenOptions *options);
+
+/**
+ * @brief Changes baudrate, mode and flow control of an open serial interface in place.
+ *        Modem lines, the lock and the file descriptor are kept.
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @param[in] baudrate expressed in baud per second i.e 115200.
+ *
+ * @param[in] mode is a string in the form of "8N1", "7O2", "8E1", etc.
+ *
+ * @param[in] flags can be combined using the bit-wise OR operator.
+ *            RS232_FLAGS_HWFLOWCTRL enables hardware flow control.
+ *            RS232_FLAGS_DRAIN applies the settings after all data written has been transmitted,
+ *            otherwise they are applied immediately.
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_Reconfigure(RS232_FD fd, int baudrate, const char *mode, int flags);
+
 /**
  * @brief Closes the serial interface.
  * 
@@ -84,12 +213,57 @@ RS232_ADDAPI int RS232_ADDCALL RS232_Close(RS232_FD);
  * 
  * @param[in] size is the buffer size.
  * 
+ * @param[in] flags can be combined using the bit-wise OR operator.
+ *            Supported flags: RS232_FLAGS_READSOME, RS232_FLAGS_KERNELTIMEOUT.
+ * 
  * @param[in] timeout_msec is the timeout in milliseconds. 0: non-blocking read, INT_MAX: blocking read.
  * 
  * @return Amount of bytes received (and stored): >= 0 if could read successfully or -1 if an error occured.
  */
 RS232_ADDAPI ssize_t RS232_ADDCALL RS232_Read(RS232_FD fd, void *buf, size_t size, int flags, int timeout_msec);
 
+/**
+ * @brief Same as RS232_Read but with an absolute deadline instead of a relative timeout.
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @param[out] buf is a buffer where data read from serial interface will be stored.
+ *
+ * @param[in] size is the buffer size.
+ *
+ * @param[in] flags are the same as for RS232_Read.
+ *
+ * @param[in] deadline is an absolute point in time on the CLOCK_MONOTONIC clock, see timespec_deadline_usec.
+ *            A deadline in the past makes a non-blocking read, NULL a blocking read.
+ *
+ * @return Amount of bytes received (and stored): >= 0 if could read successfully or -1 if an error occured.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_ReadUntil(RS232_FD fd, void *buf, size_t size, int flags, const struct timespec *deadline);
+
+/**
+ * @brief Reads from serial interface at least min_size bytes and up to size bytes and stores them in buf.
+ *        Returns as soon as min_size bytes have been received and the line has been idle for
+ *        idle_timeout_msec, or the buffer is full, or timeout_msec has expired.
+ * 
+ * @param[in] fd file descriptor.
+ * 
+ * @param[out] buf is a buffer where data read from serial interface will be stored.
+ * 
+ * @param[in] size is the buffer size.
+ * 
+ * @param[in] min_size is the minimal amount of bytes to wait for. 0 is treated as 1.
+ * 
+ * @param[in] flags are the same as for RS232_Read.
+ * 
+ * @param[in] timeout_msec is the overall timeout in milliseconds. 0: non-blocking read, INT_MAX: blocking read.
+ * 
+ * @param[in] idle_timeout_msec is the inter-byte timeout in milliseconds once min_size bytes have been
+ *            received. 0: return right after min_size bytes have been received.
+ * 
+ * @return Amount of bytes received (and stored): >= 0 if could read successfully or -1 if an error occured.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_ReadSome(RS232_FD fd, void *buf, size_t size, size_t min_size, int flags, int timeout_msec, int idle_timeout_msec);
+
 /**
  * @brief Writes to serial interface up to size bytes stored in buf.
  * 
@@ -105,6 +279,126 @@ RS232_ADDAPI ssize_t RS232_ADDCALL RS232_Read(RS232_FD fd, void *buf, size_t siz
  */
 RS232_ADDAPI ssize_t RS232_ADDCALL RS232_Write(RS232_FD fd, const void *buf, size_t size, int flags, int timeout_msec);
 
+/**
+ * @brief Same as RS232_Write but with an absolute deadline instead of a relative timeout.
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @param[in] buf is a buffer with data to send via the serial interface.
+ *
+ * @param[in] size is the amount of data to send.
+ *
+ * @param[in] flags are the same as for RS232_Write.
+ *
+ * @param[in] deadline is an absolute point in time on the CLOCK_MONOTONIC clock, see timespec_deadline_usec.
+ *            A deadline in the past makes a non-blocking write, NULL a blocking write.
+ *
+ * @return Amount of bytes sent: >=0 if could write successfully or -1 if an error occured.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_WriteUntil(RS232_FD fd, const void *buf, size_t size, int flags, const struct timespec *deadline);
+
+/**
+ * @brief Reads from serial interface into several buffers (scatter read, readv on POSIX).
+ *        Buffers are filled in order, partial progress is carried across buffer boundaries.
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @param[in] iov are the buffers (iov_base, iov_len) to fill.
+ *
+ * @param[in] iovcnt is the number of buffers.
+ *
+ * @param[in] flags, timeout_msec are the same as for RS232_Read.
+ *
+ * @return Amount of bytes received (and stored): >= 0 if could read successfully or -1 if an error occured.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_Readv(RS232_FD fd, const RS232_IOVec *iov, int iovcnt, int flags, int timeout_msec);
+
+/**
+ * @brief Writes several buffers to serial interface (gather write, writev on POSIX),
+ *        e.g. header, payload and trailer of a packet without copying them together first.
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @param[in] iov are the buffers (iov_base, iov_len) to send.
+ *
+ * @param[in] iovcnt is the number of buffers.
+ *
+ * @param[in] flags, timeout_msec are the same as for RS232_Write.
+ *
+ * @return Amount of bytes sent: >=0 if could write successfully or -1 if an error occured.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_Writev(RS232_FD fd, const RS232_IOVec *iov, int iovcnt, int flags, int timeout_msec);
+
+/** Modem line DTR (output). */
+#define RS232_LINE_DTR  (1 << 0)
+
+/** Modem line RTS (output). */
+#define RS232_LINE_RTS  (1 << 1)
+
+/** Modem line CTS (input). */
+#define RS232_LINE_CTS  (1 << 2)
+
+/** Modem line DSR (input). */
+#define RS232_LINE_DSR  (1 << 3)
+
+/** Modem line DCD (input). */
+#define RS232_LINE_DCD  (1 << 4)
+
+/** Modem line RI (input). */
+#define RS232_LINE_RI   (1 << 5)
+
+/**
+ * @brief Gets the state of all modem lines with a single call.
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @return Combination of RS232_LINE_* for the lines being high (active state) or -1 on error.
+ *         The state of DTR and RTS is not reported on Windows.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_GetModemLines(RS232_FD fd);
+
+/**
+ * @brief Sets and clears any combination of DTR and RTS with a single ioctl each (TIOCMBIS/TIOCMBIC),
+ *        other lines are not touched.
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @param[in] set lines to set high (active state), combination of RS232_LINE_DTR and RS232_LINE_RTS.
+ *
+ * @param[in] clear lines to set low (inactive state), must not overlap set.
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_SetModemLines(RS232_FD fd, int set, int clear);
+
+/** RS-485 half-duplex settings: RTS switches the transceiver between sending and receiving. */
+typedef struct
+{
+  int rts_on_send;                /**< 1: RTS is high while sending, 0: RTS is low while sending. */
+  int delay_before_send_msec;     /**< Time between switching to send and the first bit. */
+  int delay_after_send_msec;      /**< Time between the last bit and switching back to receive. */
+  int rx_during_tx;               /**< 1: receive own data while sending (echo), 0: don't. */
+} RS232_RS485Config;
+
+/**
+ * @brief Initializes config with RTS high while sending, no delays and no echo.
+ *
+ * @param[out] config to initialize.
+ */
+RS232_ADDAPI void RS232_ADDCALL RS232_RS485ConfigInit(RS232_RS485Config *config);
+
+/**
+ * @brief Lets the driver switch RTS around every transmission (TIOCSRS485). On Windows only
+ *        rts_on_send without delays is supported (RTS_CONTROL_TOGGLE).
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @param[in] config RS-485 settings or NULL to switch RS-485 mode off.
+ *
+ * @return 0 on success or -1 if the driver doesn't support it.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_SetRS485(RS232_FD fd, const RS232_RS485Config *config);
+
 /**.
  * @brief Checks the status of the DCD-pin.
  *
@@ -224,6 +518,861 @@ RS232_ADDAPI int RS232_ADDCALL RS232_flushTX(RS232_FD fd);
  */
 RS232_ADDAPI int RS232_ADDCALL RS232_flushRXTX(RS232_FD fd);
 
+/** UART interrupt counters, see RS232_GetICounter. Counters wrap around. */
+typedef struct
+{
+  uint32_t rx;            /**< Characters received. */
+  uint32_t tx;            /**< Characters transmitted. */
+  uint32_t frame;         /**< Framing errors. */
+  uint32_t overrun;       /**< Hardware overruns: the UART FIFO was full. */
+  uint32_t parity;        /**< Parity errors. */
+  uint32_t brk;           /**< Breaks received. */
+  uint32_t buf_overrun;   /**< Software overruns: the driver buffer was full. */
+} RS232_ICounter;
+
+/**
+ * @brief Reads the UART interrupt counters (TIOCGICOUNT). Lost or corrupted data shows up
+ *        there as overruns and framing errors.
+ * @note  Linux only and not supported by every driver.
+ *
+ * @param[in] fd file descriptor of the serial interface.
+ *
+ * @param[out] counter receives the counters since the driver has been loaded.
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_GetICounter(RS232_FD fd, RS232_ICounter *counter);
+
+/**.
+ * @brief Gets the baudrate the serial interface is actually running at.
+ * @note  On Linux this is the rate the driver has achieved, which may differ from the one requested.
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @return Baudrate on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_GetBaudrate(RS232_FD fd);
+
+/**.
+ * @brief Sets termios VMIN/VTIME, for applications doing their own blocking reads on fd.
+ *        read() returns once min_size bytes have arrived, or once the line has been idle
+ *        for timeout_msec after the first byte (or from the start if min_size is 0).
+ *        Not needed for RS232_FLAGS_KERNELTIMEOUT, which sets VMIN/VTIME for every read itself.
+ * @note  Has no effect on the non-blocking reads of this library.
+ * @note  On Windows the driver always does the waiting; this call does nothing.
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @param[in] min_size is the amount of bytes to wait for, up to 255 (VMIN).
+ *
+ * @param[in] timeout_msec is the timeout in milliseconds, rounded up to 100 and limited to 25500 (VTIME).
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_SetReadTimeouts(RS232_FD fd, size_t min_size, int timeout_msec);
+
+/**
+ * @brief Gets the amount of received bytes waiting in the kernel input queue (TIOCINQ).
+ *
+ * @param[in] fd file descriptor of the serial interface.
+ *
+ * @return Amount of bytes or -1 on error.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_BytesAvailable(RS232_FD fd);
+
+/**
+ * @brief Gets the amount of bytes waiting in the kernel output queue (TIOCOUTQ).
+ *
+ * @param[in] fd file descriptor of the serial interface.
+ *
+ * @return Amount of bytes or -1 on error.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_BytesPending(RS232_FD fd);
+
+/**
+ * @brief Waits until all written data has been transmitted, including the transmit shift register.
+ *
+ * @param[in] fd file descriptor of the serial interface.
+ *
+ * @param[in] deadline is the absolute CLOCK_MONOTONIC time to give up at. NULL: wait forever (tcdrain).
+ *            The output queue and the transmitter (TIOCSERGETLSR on Linux) are polled until then.
+ *            Drivers without transmitter status get tcdrain for the last bytes in the UART,
+ *            which can outlast the deadline by the time the hardware FIFO needs.
+ *
+ * @return 0 if transmitted or -1 on error or timeout.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_Drain(RS232_FD fd, const struct timespec *deadline);
+
+/** Poller event: data can be read without blocking. */
+#define RS232_POLL_IN   (1 << 0)
+
+/** Poller event: data can be written without blocking. */
+#define RS232_POLL_OUT  (1 << 1)
+
+/** Poller event: error or hangup on the interface. Always reported, no need to request it. */
+#define RS232_POLL_ERR  (1 << 2)
+
+/** Poller object that waits on many serial interfaces at once. */
+typedef struct RS232_Poller RS232_Poller;
+
+/** Event reported by RS232_PollerWait. */
+typedef struct
+{
+  RS232_FD fd;        /**< File descriptor the event belongs to. */
+  int events;         /**< Combination of RS232_POLL_IN, RS232_POLL_OUT and RS232_POLL_ERR. */
+  void *userdata;     /**< User data given while registering the file descriptor. */
+} RS232_PollEvent;
+
+/**
+ * @brief Creates a poller. Uses epoll on Linux and poll on other POSIX systems.
+ * @note  Not supported on Windows.
+ *
+ * @return Poller or NULL on error.
+ */
+RS232_ADDAPI RS232_Poller * RS232_ADDCALL RS232_PollerCreate(void);
+
+/**
+ * @brief Destroys the poller. Registered file descriptors are not closed.
+ *
+ * @param[in] poller created by RS232_PollerCreate.
+ */
+RS232_ADDAPI void RS232_ADDCALL RS232_PollerDestroy(RS232_Poller *poller);
+
+/**
+ * @brief Registers a file descriptor.
+ *
+ * @param[in] poller created by RS232_PollerCreate.
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @param[in] events to wait for: RS232_POLL_IN and/or RS232_POLL_OUT.
+ *
+ * @param[in] userdata is returned with every event of this file descriptor.
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_PollerAdd(RS232_Poller *poller, RS232_FD fd, int events, void *userdata);
+
+/**
+ * @brief Changes the events and user data of a registered file descriptor.
+ *
+ * @param[in] poller created by RS232_PollerCreate.
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @param[in] events to wait for: RS232_POLL_IN and/or RS232_POLL_OUT.
+ *
+ * @param[in] userdata is returned with every event of this file descriptor.
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_PollerModify(RS232_Poller *poller, RS232_FD fd, int events, void *userdata);
+
+/**
+ * @brief Unregisters a file descriptor. Must be called before the file descriptor is closed.
+ *
+ * @param[in] poller created by RS232_PollerCreate.
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_PollerRemove(RS232_Poller *poller, RS232_FD fd);
+
+/**
+ * @brief Waits until at least one registered file descriptor is ready.
+ *
+ * @param[in] poller created by RS232_PollerCreate.
+ *
+ * @param[out] events is an array where ready events will be stored.
+ *
+ * @param[in] max_events is the size of the events array.
+ *
+ * @param[in] timeout_msec is the timeout in milliseconds. 0: non-blocking, INT_MAX: blocking.
+ *
+ * @return Amount of events stored: > 0 if ready, 0 on timeout or -1 if an error occured.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_PollerWait(RS232_Poller *poller, RS232_PollEvent *events, int max_events, int timeout_msec);
+
+/** Receive buffer owned by the library, see RS232_RxBufferCreate. */
+typedef struct RS232_RxBuffer RS232_RxBuffer;
+
+/**
+ * @brief Creates a receive buffer for a serial interface. It is filled with large reads,
+ *        parsers work on the buffered data in place with RS232_RxBufferPeek and RS232_RxBufferConsume.
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @param[in] capacity is the buffer size in bytes.
+ *
+ * @return Receive buffer or NULL on error.
+ */
+RS232_ADDAPI RS232_RxBuffer * RS232_ADDCALL RS232_RxBufferCreate(RS232_FD fd, size_t capacity);
+
+/**
+ * @brief Destroys the receive buffer. The serial interface is not closed.
+ *
+ * @param[in] rb receive buffer.
+ */
+RS232_ADDAPI void RS232_ADDCALL RS232_RxBufferDestroy(RS232_RxBuffer *rb);
+
+/**
+ * @brief Waits for data and appends whatever is available to the buffer with a single read.
+ *
+ * @param[in] rb receive buffer.
+ *
+ * @param[in] flags are the same as for RS232_Read.
+ *
+ * @param[in] timeout_msec is the timeout in milliseconds. 0: non-blocking, INT_MAX: blocking.
+ *
+ * @return Amount of bytes added: > 0 on success, 0 on timeout or if the buffer is full, -1 if an error occured.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_RxBufferFill(RS232_RxBuffer *rb, int flags, int timeout_msec);
+
+/**
+ * @brief Gives access to all buffered data without copying it.
+ *        The pointer stays valid until the next call filling or consuming the buffer.
+ *
+ * @param[in] rb receive buffer.
+ *
+ * @param[out] data points to the first buffered byte.
+ *
+ * @param[out] len is the amount of buffered bytes.
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_RxBufferPeek(RS232_RxBuffer *rb, const void **data, size_t *len);
+
+/**
+ * @brief Drops n bytes from the front of the buffer.
+ *
+ * @param[in] rb receive buffer.
+ *
+ * @param[in] n is the amount of bytes to drop, at most the amount given by RS232_RxBufferPeek.
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_RxBufferConsume(RS232_RxBuffer *rb, size_t n);
+
+/**
+ * @brief Same as RS232_Read but serves buffered data first and refills the buffer with large reads.
+ *
+ * @param[in] rb receive buffer.
+ *
+ * @param[out] buf, size, flags, timeout_msec are the same as for RS232_Read.
+ *
+ * @return Amount of bytes stored: >= 0 if could read successfully or -1 if an error occured.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_RxBufferRead(RS232_RxBuffer *rb, void *buf, size_t size, int flags, int timeout_msec);
+
+/**
+ * @brief Reads exactly one frame terminated by any of the delimiters. Bytes following the frame
+ *        stay in the buffer for the next call, so a burst of many frames costs one read.
+ *        If the buffer fills up without a delimiter, its content is returned as a frame
+ *        not ending with a delimiter.
+ *
+ * @param[in] rb receive buffer.
+ *
+ * @param[in] delims are the delimiter bytes, e.g. "\r\n" or "\x03".
+ *
+ * @param[in] ndelims is the amount of delimiter bytes.
+ *
+ * @param[in] flags are the same as for RS232_Read.
+ *
+ * @param[in] timeout_msec is the timeout in milliseconds. 0: non-blocking, INT_MAX: blocking.
+ *
+ * @param[out] frame points to the frame inside the buffer. It stays valid until the next call on rb.
+ *
+ * @return Frame length including the delimiter: > 0 on success, 0 on timeout or -1 if an error occured.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_RxBufferReadFrame(RS232_RxBuffer *rb, const void *delims, size_t ndelims, int flags, int timeout_msec, const void **frame);
+
+/**
+ * @brief Drops the rest of the frame being received, e.g. after RS232_RxBufferReadFrame returned
+ *        a full buffer without delimiter. The next RS232_RxBufferReadFrame skips everything up to
+ *        and including the next delimiter, across calls and timeouts.
+ *
+ * @param[in] rb receive buffer.
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_RxBufferDiscardFrame(RS232_RxBuffer *rb);
+
+/** Returned by RS232_TxQueueSend if the data doesn't fit into the queue. */
+#define RS232_TXQUEUE_FULL  1
+
+/** Priority of urgent data, e.g. an emergency stop. Sent ahead of bulk data at the next frame boundary. */
+#define RS232_TXPRIO_HIGH   0
+
+/** Priority of bulk data, e.g. a firmware image. Used by RS232_TxQueueSend. */
+#define RS232_TXPRIO_BULK   1
+
+/** Number of priorities. */
+#define RS232_TXPRIO_COUNT  2
+
+/** Transmit queue drained by a background writer, see RS232_TxQueueCreate. */
+typedef struct RS232_TxQueue RS232_TxQueue;
+
+/**
+ * @brief Called from the writer thread once queued data has been written.
+ *
+ * @param[in] written_bytes is the result of RS232_Write for the data, -1 if the queue was destroyed before.
+ *
+ * @param[in] userdata given to RS232_TxQueueSend.
+ */
+typedef void (*RS232_TxCallback)(ssize_t written_bytes, void *userdata);
+
+/**
+ * @brief Creates a transmit queue with its own writer thread. Data is queued without blocking
+ *        the caller and written to the serial interface by priority, see RS232_TxQueueSendPrio,
+ *        data of the same priority in the order it has been queued.
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @param[in] max_bytes is the maximal amount of bytes queued or being written per priority,
+ *            so that bulk data filling the queue leaves room for urgent data.
+ *
+ * @param[in] write_timeout_msec is the timeout of every RS232_Write done by the writer thread.
+ *
+ * @return Transmit queue or NULL on error.
+ */
+RS232_ADDAPI RS232_TxQueue * RS232_ADDCALL RS232_TxQueueCreate(RS232_FD fd, size_t max_bytes, int write_timeout_msec);
+
+/**
+ * @brief Stops the writer thread after the data being written and destroys the queue.
+ *        Callbacks of data not written yet are called with -1. The serial interface is not closed.
+ *
+ * @param[in] q transmit queue.
+ */
+RS232_ADDAPI void RS232_ADDCALL RS232_TxQueueDestroy(RS232_TxQueue *q);
+
+/**
+ * @brief Copies data into the queue without blocking.
+ *
+ * @param[in] q transmit queue.
+ *
+ * @param[in] buf is a buffer with data to send via the serial interface.
+ *
+ * @param[in] size is the amount of data to send.
+ *
+ * @param[in] callback is called once the data has been written, may be NULL.
+ *
+ * @param[in] userdata is passed to callback.
+ *
+ * @return 0 if queued, RS232_TXQUEUE_FULL if there is no room for the data (back-pressure) or -1 on error.
+ *         Data larger than max_bytes never fits, -1 is returned with errno set to EMSGSIZE.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_TxQueueSend(RS232_TxQueue *q, const void *buf, size_t size, RS232_TxCallback callback, void *userdata);
+
+/**
+ * @brief Same as RS232_TxQueueSend but with a priority. Data of higher priority is written first,
+ *        data of the same priority in the order it has been queued. Every call queues one frame:
+ *        a frame being written is never interrupted.
+ *        Every priority has its own budget of max_bytes.
+ *
+ * @param[in] q transmit queue.
+ *
+ * @param[in] buf, size, callback, userdata are the same as for RS232_TxQueueSend.
+ *
+ * @param[in] prio is RS232_TXPRIO_HIGH or RS232_TXPRIO_BULK.
+ *
+ * @return 0 if queued, RS232_TXQUEUE_FULL if there is no room for the data (back-pressure) or -1 on error.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_TxQueueSendPrio(RS232_TxQueue *q, const void *buf, size_t size, int prio,
+                                                    RS232_TxCallback callback, void *userdata);
+
+/**
+ * @brief Keeps the kernel output queue shallow: the writer only hands data to the kernel when
+ *        the output queue (TIOCOUTQ) holds less than outq_limit bytes. This bounds the time urgent
+ *        data waits behind bulk data already given to the kernel.
+ * @note  Call again after the baudrate has been changed.
+ *
+ * @param[in] q transmit queue.
+ *
+ * @param[in] outq_limit is the maximal fill level in bytes, 0: no limit (default).
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_TxQueueSetOutqLimit(RS232_TxQueue *q, size_t outq_limit);
+
+/**
+ * @brief Gets the amount of bytes queued or being written, of all priorities.
+ *
+ * @param[in] q transmit queue.
+ *
+ * @return Amount of bytes.
+ */
+RS232_ADDAPI size_t RS232_ADDCALL RS232_TxQueuePending(RS232_TxQueue *q);
+
+/**
+ * @brief Waits until all queued data has been written.
+ *
+ * @param[in] q transmit queue.
+ *
+ * @param[in] timeout_msec is the timeout in milliseconds. INT_MAX: wait forever.
+ *
+ * @return 0 if the queue is empty or -1 on timeout.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_TxQueueFlush(RS232_TxQueue *q, int timeout_msec);
+
+/** io_uring instance submitting reads and writes of many serial interfaces in batches. */
+typedef struct RS232_Uring RS232_Uring;
+
+/** Completion reported by RS232_UringSubmit. */
+typedef struct
+{
+  RS232_FD fd;        /**< File descriptor the request belongs to. */
+  ssize_t result;     /**< Amount of bytes transferred, 0 on timeout or -1 on error. */
+  int error;          /**< errno value if result is -1. */
+  void *userdata;     /**< User data given while preparing the request. */
+} RS232_UringCompletion;
+
+/**
+ * @brief Creates an io_uring instance. Each request is submitted as a poll linked to the read
+ *        or write, with an optional linked timeout, so one RS232_UringSubmit call serves many
+ *        interfaces without a poll and read pair per interface.
+ * @note  Needs WITH_RS232_IO_URING and Linux 5.11 or newer. Returns NULL otherwise, in which case
+ *        RS232_Read and RS232_Write are to be used.
+ *
+ * @param[in] max_requests is the maximal amount of requests in flight.
+ *
+ * @return io_uring instance or NULL if io_uring is not available.
+ */
+RS232_ADDAPI RS232_Uring * RS232_ADDCALL RS232_UringCreate(unsigned max_requests);
+
+/**
+ * @brief Destroys the io_uring instance. Requests in flight are cancelled.
+ *
+ * @param[in] uring created by RS232_UringCreate.
+ */
+RS232_ADDAPI void RS232_ADDCALL RS232_UringDestroy(RS232_Uring *uring);
+
+/**
+ * @brief Registers buffers with the kernel, which saves mapping them on every request.
+ *
+ * @param[in] uring created by RS232_UringCreate.
+ *
+ * @param[in] iov buffers to register, indexed by position.
+ *
+ * @param[in] iovcnt is the amount of buffers.
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_UringRegisterBuffers(RS232_Uring *uring, const RS232_IOVec *iov, int iovcnt);
+
+/**
+ * @brief Prepares a read. The request is handed to the kernel by the next RS232_UringSubmit.
+ *
+ * @param[in] uring created by RS232_UringCreate.
+ *
+ * @param[in] fd file descriptor of the serial interface.
+ *
+ * @param[out] buf receives the data, must stay valid until the request has completed.
+ *
+ * @param[in] size is the size of buf.
+ *
+ * @param[in] buf_index is the index of the registered buffer containing buf or -1 if not registered.
+ *
+ * @param[in] timeout_msec is the timeout in milliseconds. INT_MAX: wait forever.
+ *
+ * @param[in] userdata is reported with the completion.
+ *
+ * @return 0 on success or -1 if too many requests are in flight.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_UringPrepRead(RS232_Uring *uring, RS232_FD fd, void *buf, size_t size, int buf_index,
+                                                  int timeout_msec, void *userdata);
+
+/**
+ * @brief Prepares a write. The request is handed to the kernel by the next RS232_UringSubmit.
+ *
+ * @param[in] uring, fd, size, buf_index, timeout_msec and userdata are the same as for RS232_UringPrepRead.
+ *
+ * @param[in] buf contains the data, must stay valid until the request has completed.
+ *
+ * @return 0 on success or -1 if too many requests are in flight.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_UringPrepWrite(RS232_Uring *uring, RS232_FD fd, const void *buf, size_t size, int buf_index,
+                                                   int timeout_msec, void *userdata);
+
+/**
+ * @brief Submits all prepared requests with a single system call and waits for completions.
+ *
+ * @param[in] uring created by RS232_UringCreate.
+ *
+ * @param[out] completions receives completed requests.
+ *
+ * @param[in] max_completions is the size of completions.
+ *
+ * @param[in] timeout_msec is the time to wait for the first completion in milliseconds. 0: don't wait, INT_MAX: wait forever.
+ *
+ * @return Amount of completions, 0 on timeout or -1 on error.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_UringSubmit(RS232_Uring *uring, RS232_UringCompletion *completions, int max_completions, int timeout_msec);
+
+/**
+ * Serial interface together with its state: configuration, receive buffer and so on.
+ * The RS232_FD functions stay available, RS232_PortFD gives access to them.
+ */
+typedef struct RS232_Port RS232_Port;
+
+/**
+ * @brief Opens the serial interface and creates a port for it.
+ *
+ * @param[in] devname, baudrate, mode, flags are the same as for RS232_Open.
+ *
+ * @param[in] options retry policy or NULL for the one of RS232_Open.
+ *
+ * @return Port or NULL if something went wrong while opening interface.
+ */
+RS232_ADDAPI RS232_Port * RS232_ADDCALL RS232_PortOpen(const char *devname, int baudrate, const char *mode, int flags, const RS232_OpenOptions *options);
+
+/**
+ * @brief Closes the serial interface and destroys the port.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_PortClose(RS232_Port *port);
+
+/**
+ * @brief Gets the file descriptor of the port for use with the RS232_FD functions.
+ *        Don't close it and don't change the configuration behind the back of the port.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @return File descriptor.
+ */
+RS232_ADDAPI RS232_FD RS232_ADDCALL RS232_PortFD(const RS232_Port *port);
+
+/**
+ * @brief Gets the baudrate actually set, without asking the driver.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @return Baudrate in baud per second.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_PortGetBaudrate(const RS232_Port *port);
+
+/**
+ * @brief Gets the mode the port has been configured with, e.g. "8N1".
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @return Mode or NULL on error.
+ */
+RS232_ADDAPI const char * RS232_ADDCALL RS232_PortGetMode(const RS232_Port *port);
+
+/**
+ * @brief Same as RS232_Reconfigure, also updates the state of the port.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @param[in] baudrate, mode, flags are the same as for RS232_Reconfigure.
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_PortReconfigure(RS232_Port *port, int baudrate, const char *mode, int flags);
+
+/**
+ * @brief Adds a receive buffer to the port: RS232_PortRead is then served by RS232_RxBufferRead.
+ *        Data still buffered is dropped when the buffer is replaced or removed.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @param[in] capacity is the size of the buffer in bytes, 0 removes the buffer.
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_PortSetRxBuffer(RS232_Port *port, size_t capacity);
+
+/**
+ * @brief Gets the receive buffer of the port, e.g. for RS232_RxBufferReadFrame.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @return Receive buffer or NULL if there is none.
+ */
+RS232_ADDAPI RS232_RxBuffer * RS232_ADDCALL RS232_PortRxBuffer(const RS232_Port *port);
+
+/**
+ * @brief Same as RS232_Read, served from the receive buffer if the port has one.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @param[out] buf, size, flags, timeout_msec are the same as for RS232_Read.
+ *
+ * @return Amount of bytes stored: >= 0 if could read successfully or -1 if an error occured.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_PortRead(RS232_Port *port, void *buf, size_t size, int flags, int timeout_msec);
+
+/**
+ * @brief Same as RS232_ReadUntil, served from the receive buffer if the port has one.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @param[out] buf, size, flags, deadline are the same as for RS232_ReadUntil.
+ *
+ * @return Amount of bytes stored: >= 0 if could read successfully or -1 if an error occured.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_PortReadUntil(RS232_Port *port, void *buf, size_t size, int flags, const struct timespec *deadline);
+
+/**
+ * @brief Same as RS232_Write.
+ * @note  In software RS-485 mode the call waits for the written bytes to be transmitted before
+ *        switching RTS back, which may take up to their transmission time past timeout_msec.
+ *        If they are not transmitted by then, e.g. held back by flow control, they are
+ *        discarded and -1 is returned.
+ *        The output lines are locked meanwhile, RS232_PortSetModemLines and
+ *        RS232_PortGetOutputLines wait for the transmission to complete.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @param[in] buf, size, flags, timeout_msec are the same as for RS232_Write.
+ *
+ * @return Amount of bytes written: >= 0 if could write successfully or -1 if an error occured.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_PortWrite(RS232_Port *port, const void *buf, size_t size, int flags, int timeout_msec);
+
+/**
+ * @brief Same as RS232_SetModemLines but keeps track of the output lines, so that lines already
+ *        in the requested state cost nothing and any change costs a single ioctl. Safe to be
+ *        called from several threads. Waits for a software RS-485 transmission in progress.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @param[in] set, clear are the same as for RS232_SetModemLines.
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_PortSetModemLines(RS232_Port *port, int set, int clear);
+
+/**
+ * @brief Gets the output lines as last set, without asking the driver. Waits for a software
+ *        RS-485 transmission in progress.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @return Combination of RS232_LINE_DTR and RS232_LINE_RTS for the lines being high or -1 if unknown.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_PortGetOutputLines(RS232_Port *port);
+
+/**
+ * @brief Writes as much as fits into the driver without waiting, for event loops.
+ *        In software RS-485 mode RTS is switched to send before the first byte, after
+ *        delay_before_send_msec, and stays so until RS232_PortWriteAsyncEnd.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @param[in] buf is a buffer with data to send via the serial interface.
+ *
+ * @param[in] size is the amount of data to send.
+ *
+ * @return Amount of bytes written: >= 0, 0 if the driver has no room, or -1 on error.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_PortWriteAsync(RS232_Port *port, const void *buf, size_t size);
+
+/**
+ * @brief Ends the writes of RS232_PortWriteAsync without waiting. In software RS-485 mode
+ *        RTS is switched back once the data has been transmitted and delay_after_send_msec
+ *        has passed, call it again until it returns 1. Does nothing in other modes.
+ * @note  Drivers without transmitter status (TIOCSERGETLSR) only report the output queue,
+ *        call it no earlier than the end of the transmission estimated from the baudrate.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @return 1 if done, 0 if the data is still being transmitted or -1 on error.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_PortWriteAsyncEnd(RS232_Port *port);
+
+/** RS232_PortSetRS485: the driver has no RS-485 support, RS232_PortWrite switches RTS itself. */
+#define RS232_RS485_SOFTWARE  1
+
+/**
+ * @brief Switches the port to RS-485 half-duplex mode. Uses RS232_SetRS485 if the driver supports it,
+ *        otherwise RS232_PortWrite switches RTS, waits delay_before_send_msec, writes, waits with
+ *        RS232_Drain until the last bit is out, waits delay_after_send_msec and switches back.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @param[in] config RS-485 settings or NULL to switch RS-485 mode off.
+ *
+ * @return 0 if the driver switches RTS, RS232_RS485_SOFTWARE if RS232_PortWrite does or -1 on error.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_PortSetRS485(RS232_Port *port, const RS232_RS485Config *config);
+
+/** Number of buckets of the histograms in RS232_Stats. */
+#define RS232_STATS_BUCKETS  32
+
+/**
+ * Counters of a port. A call is one wait for the interface followed by one read() or write(),
+ * the system calls it took are counted separately: a timed out call costs one poll, a successful
+ * one a poll and a read() or write(). A read with RS232_FLAGS_KERNELTIMEOUT costs tcgetattr(),
+ * tcsetattr() when VMIN/VTIME change, two fcntl() around the read() to clear O_NONBLOCK, and
+ * a poll for the last part of the timeout shorter than 100 ms.
+ * On Windows the driver does the waiting and the system call counters stay 0.
+ * Histogram bucket i counts values in [2^i, 2^(i+1)), bucket 0 also counts 0, the last bucket
+ * everything above.
+ */
+typedef struct
+{
+  uint64_t read_calls;                                /**< Read calls. */
+  uint64_t read_bytes;                                /**< Bytes read. */
+  uint64_t read_partial;                              /**< Read calls returning less than asked for. */
+  uint64_t read_timeouts;                             /**< Read calls returning nothing within the timeout. */
+  uint64_t read_errors;                               /**< Read calls failing. */
+  uint64_t read_usec;                                 /**< Time spent in read calls, mostly waiting. */
+  uint64_t read_syscalls;                             /**< System calls made by read calls, polls included. */
+  uint64_t read_polls;                                /**< poll() system calls made by read calls. */
+  uint64_t write_calls;                               /**< Write calls. */
+  uint64_t write_bytes;                               /**< Bytes written. */
+  uint64_t write_partial;                             /**< Write calls writing less than asked for. */
+  uint64_t write_timeouts;                            /**< Write calls writing nothing within the timeout. */
+  uint64_t write_errors;                              /**< Write calls failing. */
+  uint64_t write_usec;                                /**< Time spent in write calls, mostly waiting. */
+  uint64_t write_syscalls;                            /**< System calls made by write calls, polls included. */
+  uint64_t write_polls;                               /**< poll() system calls made by write calls. */
+  uint64_t read_latency_hist[RS232_STATS_BUCKETS];    /**< Duration of read calls in microseconds. */
+  uint64_t write_latency_hist[RS232_STATS_BUCKETS];   /**< Duration of write calls in microseconds. */
+  uint64_t read_size_hist[RS232_STATS_BUCKETS];       /**< Bytes returned by successful read calls. */
+} RS232_Stats;
+
+/**
+ * @brief Enables or disables the counters of a port, they are disabled after RS232_PortOpen.
+ *        Disabled counters cost a single branch per call. Enable them before the port is
+ *        used from several threads.
+ * @note  Does nothing if compiled without WITH_RS232_STATS.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @param[in] enable is 1 to enable and 0 to disable.
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_PortEnableStats(RS232_Port *port, int enable);
+
+/**
+ * @brief Takes a snapshot of the counters. The counters are updated without locks,
+ *        so the snapshot may be slightly inconsistent while the port is in use.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @param[out] stats receives the counters.
+ *
+ * @return 0 on success or -1 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_PortGetStats(const RS232_Port *port, RS232_Stats *stats);
+
+/**
+ * @brief Sets all counters to 0.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ */
+RS232_ADDAPI void RS232_ADDCALL RS232_PortResetStats(RS232_Port *port);
+
+/**
+ * @brief Gets the change of the UART interrupt counters since the previous call,
+ *        or since RS232_PortOpen for the first call.
+ *
+ * @param[in] port created by RS232_PortOpen.
+ *
+ * @param[out] delta receives the changes.
+ *
+ * @return 0 on success or -1 otherwise, see RS232_GetICounter.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_PortGetICounterDelta(RS232_Port *port, RS232_ICounter *delta);
+
+/** Monitor sampling the UART interrupt counters of all open ports, see RS232_ICounterMonitorStart. */
+typedef struct RS232_ICounterMonitor RS232_ICounterMonitor;
+
+/**
+ * @brief Called by the monitor for every open port on every interval.
+ *        Must not open or close ports.
+ *
+ * @param[in] port being sampled.
+ *
+ * @param[in] delta is the change of the counters since the previous sample of the monitor.
+ *
+ * @param[in] userdata given to RS232_ICounterMonitorStart.
+ */
+typedef void (*RS232_ICounterCallback)(RS232_Port *port, const RS232_ICounter *delta, void *userdata);
+
+/**
+ * @brief Starts a thread sampling the UART interrupt counters of all ports opened by
+ *        RS232_PortOpen at a fixed interval. Only one monitor can run at a time.
+ *        Ports whose driver has no counters are skipped.
+ *
+ * @param[in] interval_msec is the sampling interval in milliseconds.
+ *
+ * @param[in] callback is called from the monitor thread for every port.
+ *
+ * @param[in] userdata is passed to callback.
+ *
+ * @return Monitor or NULL on error.
+ */
+RS232_ADDAPI RS232_ICounterMonitor * RS232_ADDCALL RS232_ICounterMonitorStart(int interval_msec, RS232_ICounterCallback callback, void *userdata);
+
+/**
+ * @brief Stops the monitor. No callback is running or called anymore once it has returned.
+ *
+ * @param[in] monitor started by RS232_ICounterMonitorStart.
+ */
+RS232_ADDAPI void RS232_ADDCALL RS232_ICounterMonitorStop(RS232_ICounterMonitor *monitor);
+
+/** Transition of modem lines reported by the line watcher. */
+typedef struct
+{
+  RS232_FD fd;                  /**< File descriptor being watched. */
+  int lines;                    /**< State after the transition, combination of RS232_LINE_*. */
+  int changed;                  /**< Lines that have changed, a short pulse may leave lines at the same state. */
+  struct timespec timestamp;    /**< CLOCK_MONOTONIC time the transition has been seen. */
+} RS232_LineEvent;
+
+/** Watcher of modem line transitions, see RS232_LineWatcherStart. */
+typedef struct RS232_LineWatcher RS232_LineWatcher;
+
+/**
+ * @brief Called by the line watcher for every transition. May stop the watcher.
+ *
+ * @param[in] event describes the transition.
+ *
+ * @param[in] userdata given to RS232_LineWatcherStart.
+ */
+typedef void (*RS232_LineCallback)(const RS232_LineEvent *event, void *userdata);
+
+/**
+ * @brief Starts a thread that sleeps in the driver until one of the lines changes (TIOCMIWAIT)
+ *        and then reports the transition. Replaces polling RS232_IsCTSEnabled and the like.
+ *        Transitions are counted by the driver (TIOCGICOUNT) from the start on, none is lost
+ *        while the callback is running.
+ * @note  Linux only. The driver wakes a thread sleeping in TIOCMIWAIT on line changes and
+ *        signals only, RS232_LineWatcherStop sends signo to the watcher thread while it sleeps.
+ *        A handler for signo is installed on first use, without SA_RESTART. It calls the
+ *        handler it replaces, but not the default action, so signo should be a signal the
+ *        application handles or ignores anyway, e.g. SIGRTMIN + n.
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @param[in] lines to watch, combination of RS232_LINE_CTS, RS232_LINE_DSR, RS232_LINE_DCD and RS232_LINE_RI.
+ *
+ * @param[in] callback is called from the watcher thread.
+ *
+ * @param[in] userdata is passed to callback.
+ *
+ * @param[in] signo is the signal interrupting the wait when the watcher is stopped.
+ *
+ * @return Watcher or NULL on error, also if the driver can not report line transitions.
+ */
+RS232_ADDAPI RS232_LineWatcher * RS232_ADDCALL RS232_LineWatcherStart(RS232_FD fd, int lines, RS232_LineCallback callback, void *userdata, int signo);
+
+/**
+ * @brief Stops the watcher. No callback is running or called anymore once it has returned.
+ *        Called from the callback, it returns at once and the watcher ends with the callback.
+ *
+ * @param[in] watcher started by RS232_LineWatcherStart.
+ */
+RS232_ADDAPI void RS232_ADDCALL RS232_LineWatcherStop(RS232_LineWatcher *watcher);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,355 @@
+/*
+***************************************************************************
+*
+* Author: Teunis van Beelen, Xael South
+*
+* Copyright (C) 2005 - 2023 Teunis van Beelen
+* Copyright (C) 2024 - 2024 Xael South
+*
+* Email: teuniz@protonmail.com
+*        xael.south@yandex.com
+*
+***************************************************************************
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+***************************************************************************
+*/
+
+/* 
+ * For more info and how to use this library, visit: https://github.com/xaelsouth/RS-232
+ *                                                   https://www.teuniz.net/RS-232
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include "rs232_codec.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define SLIP_END      0xC0
+#define SLIP_ESC      0xDB
+#define SLIP_ESC_END  0xDC
+#define SLIP_ESC_ESC  0xDD
+
+#define HDLC_FLAG     0x7E
+#define HDLC_ESC      0x7D
+#define HDLC_XOR      0x20
+
+/* Frames on the stack up to this size, larger ones on the heap. */
+#define CODEC_STACK_SIZE  512
+
+/*
+ * Returns the offset of the first byte in p that is a or b, or len if there is none.
+ * Compares 16 bytes at a time with SSE2 where available.
+ */
+static size_t _RS232_CodecFind2(const uint8_t *p, size_t len, uint8_t a, uint8_t b)
+{
+
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  const __m128i needle_a = _mm_set1_epi8((char)a);
+  const __m128i needle_b = _mm_set1_epi8((char)b);
+
+  for (; i + 16 <= len; i += 16)
+  {
+    __m128i block = _mm_loadu_si128((const __m128i *)(p + i));
+    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, needle_a), _mm_cmpeq_epi8(block, needle_b)));
+
+    if (mask != 0) return i + (size_t)__builtin_ctz((unsigned)mask);
+  }
+#endif
+
+  for (; i < len; i++)
+  {
+    if (p[i] == a || p[i] == b) return i;
+  }
+
+  return len;
+}
+
+static int _RS232_CodecDelimiter(int codec)
+{
+
+  switch (codec)
+  {
+    case RS232_CODEC_SLIP: return SLIP_END;
+    case RS232_CODEC_COBS: return 0x00;
+    case RS232_CODEC_HDLC: return HDLC_FLAG;
+    default: return -1;
+  }
+}
+
+RS232_ADDAPI size_t RS232_ADDCALL RS232_CodecMaxEncodedSize(int codec, size_t size)
+{
+
+  switch (codec)
+  {
+    case RS232_CODEC_SLIP:
+    case RS232_CODEC_HDLC:
+      return 2 + 2 * size;        /* Both delimiters, every byte escaped. */
+    case RS232_CODEC_COBS:
+      return 2 + size + size / 254;   /* First code byte, one per 254 bytes and the delimiter. */
+    default:
+      return 0;
+  }
+}
+
+/* Byte stuffing of SLIP and HDLC: copies runs up to the next byte to escape. */
+static ssize_t _RS232_StuffEncode(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_size, uint8_t delim, uint8_t esc, int codec)
+{
+
+  size_t o = 0;
+
+  if (dst_size < 2) return -1;
+
+  dst[o++] = delim;
+
+  for (size_t i = 0; i < size;)
+  {
+    size_t run = _RS232_CodecFind2(src + i, size - i, delim, esc);
+
+    if (dst_size - o < run + 1) return -1;
+
+    memcpy(dst + o, src + i, run);
+    o += run;
+    i += run;
+
+    if (i == size) break;
+
+    if (dst_size - o < 3) return -1;
+
+    dst[o++] = esc;
+    if (codec == RS232_CODEC_SLIP)
+      dst[o++] = (src[i] == SLIP_END) ? SLIP_ESC_END : SLIP_ESC_ESC;
+    else
+      dst[o++] = src[i] ^ HDLC_XOR;
+    i++;
+  }
+
+  dst[o++] = delim;
+
+  return (ssize_t)o;
+}
+
+static ssize_t _RS232_StuffDecode(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_size, uint8_t esc, int codec)
+{
+
+  size_t o = 0;
+
+  for (size_t i = 0; i < size;)
+  {
+    const uint8_t *found = memchr(src + i, esc, size - i);
+    size_t run = found ? (size_t)(found - (src + i)) : size - i;
+
+    if (dst_size - o < run) return -1;
+
+    memmove(dst + o, src + i, run);
+    o += run;
+    i += run;
+
+    if (i == size) break;
+
+    /* Escape byte followed by the escaped one. */
+    if (i + 1 == size || o == dst_size) return -1;
+
+    uint8_t c = src[i + 1];
+    if (codec == RS232_CODEC_SLIP)
+    {
+      if (c == SLIP_ESC_END) c = SLIP_END;
+      else if (c == SLIP_ESC_ESC) c = SLIP_ESC;
+      else return -1;
+    }
+    else
+    {
+      c ^= HDLC_XOR;
+    }
+
+    dst[o++] = c;
+    i += 2;
+  }
+
+  return (ssize_t)o;
+}
+
+static ssize_t _RS232_CobsEncode(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_size)
+{
+
+  size_t o = 0, i = 0;
+
+  if (dst_size < 2) return -1;
+
+  size_t code = o++;
+
+  for (;;)
+  {
+    size_t limit = (size - i < 254) ? size - i : 254;
+    const uint8_t *zero = memchr(src + i, 0x00, limit);
+    size_t run = zero ? (size_t)(zero - (src + i)) : limit;
+
+    /* Run and the delimiter. */
+    if (dst_size - o < run + 1) return -1;
+
+    memcpy(dst + o, src + i, run);
+    o += run;
+    i += run;
+
+    if (zero != NULL || (run == 254 && i < size))
+    {
+      /* A zero is replaced by the code byte of the next block, a full block has none. */
+      if (dst_size - o < 2) return -1;
+
+      dst[code] = (zero != NULL) ? (uint8_t)(run + 1) : 0xFF;
+      code = o++;
+      if (zero != NULL) i++;
+    }
+    else
+    {
+      dst[code] = (uint8_t)(run + 1);
+      break;
+    }
+  }
+
+  dst[o++] = 0x00;
+
+  return (ssize_t)o;
+}
+
+static ssize_t _RS232_CobsDecode(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_size)
+{
+
+  size_t o = 0;
+
+  for (size_t i = 0; i < size;)
+  {
+    uint8_t code = src[i++];
+    size_t run = code - 1;
+
+    if (code == 0x00 || run > size - i || run > dst_size - o) return -1;
+
+    memmove(dst + o, src + i, run);
+    o += run;
+    i += run;
+
+    /* Blocks shorter than 254 bytes stood for a zero, except the last one. */
+    if (code != 0xFF && i < size)
+    {
+      if (o == dst_size) return -1;
+      dst[o++] = 0x00;
+    }
+  }
+
+  return (ssize_t)o;
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_CodecEncode(int codec, const void *src, size_t size, void *dst, size_t dst_size)
+{
+
+  if ((src == NULL && size > 0) || dst == NULL) return -1;
+
+  switch (codec)
+  {
+    case RS232_CODEC_SLIP: return _RS232_StuffEncode(src, size, dst, dst_size, SLIP_END, SLIP_ESC, codec);
+    case RS232_CODEC_COBS: return _RS232_CobsEncode(src, size, dst, dst_size);
+    case RS232_CODEC_HDLC: return _RS232_StuffEncode(src, size, dst, dst_size, HDLC_FLAG, HDLC_ESC, codec);
+    default: return -1;
+  }
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_CodecDecode(int codec, const void *_src, size_t size, void *dst, size_t dst_size)
+{
+
+  const uint8_t *src = _src;
+  int delim = _RS232_CodecDelimiter(codec);
+
+  if (delim < 0 || (src == NULL && size > 0) || dst == NULL) return -1;
+
+  while (size > 0 && src[0] == delim)
+  {
+    src++;
+    size--;
+  }
+
+  while (size > 0 && src[size - 1] == delim)
+  {
+    size--;
+  }
+
+  switch (codec)
+  {
+    case RS232_CODEC_SLIP: return _RS232_StuffDecode(src, size, dst, dst_size, SLIP_ESC, codec);
+    case RS232_CODEC_COBS: return _RS232_CobsDecode(src, size, dst, dst_size);
+    default:               return _RS232_StuffDecode(src, size, dst, dst_size, HDLC_ESC, codec);
+  }
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_CodecWrite(RS232_FD fd, int codec, const void *buf, size_t size, int flags, int timeout_msec)
+{
+
+  uint8_t stack[CODEC_STACK_SIZE];
+  size_t max_size = RS232_CodecMaxEncodedSize(codec, size);
+
+  if (max_size == 0) return -1;
+
+  uint8_t *frame = (max_size <= sizeof(stack)) ? stack : malloc(max_size);
+  if (frame == NULL) return -1;
+
+  ssize_t frame_len = RS232_CodecEncode(codec, buf, size, frame, max_size);
+  ssize_t written_bytes = (frame_len > 0) ? RS232_Write(fd, frame, (size_t)frame_len, flags, timeout_msec) : -1;
+
+  if (frame != stack) free(frame);
+
+  return (frame_len > 0 && written_bytes == frame_len) ? (ssize_t)size : -1;
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_CodecReadFrame(RS232_RxBuffer *rb, int codec, void *buf, size_t size, int flags, int timeout_msec)
+{
+
+  struct timespec deadline, remaining;
+  int delim = _RS232_CodecDelimiter(codec);
+  uint8_t delims[1];
+
+  if (rb == NULL || delim < 0 || buf == NULL) return -1;
+
+  delims[0] = (uint8_t)delim;
+
+  if (timeout_msec != INT_MAX) timespec_deadline_usec(&deadline, timeout_msec * 1000LL);
+
+  for (;;)
+  {
+    const void *frame;
+    int wait_msec = INT_MAX;
+
+    if (timeout_msec != INT_MAX) wait_msec = timespec_remaining(&deadline, &remaining) ? timespec_to_msec_ceil(&remaining) : 0;
+
+    ssize_t frame_len = RS232_RxBufferReadFrame(rb, delims, sizeof(delims), flags, wait_msec, &frame);
+    if (frame_len <= 0) return frame_len;
+
+    /* The buffer filled up without a delimiter, the rest of the frame must not pass for one. */
+    if (((const uint8_t *)frame)[frame_len - 1] != delims[0])
+    {
+      RS232_RxBufferDiscardFrame(rb);
+      return -1;
+    }
+
+    ssize_t len = RS232_CodecDecode(codec, frame, (size_t)frame_len, buf, size);
+    if (len != 0) return len;
+  }
+}
@@ -0,0 +1,138 @@
+/*
+***************************************************************************
+*
+* Author: Teunis van Beelen, Xael South
+*
+* Copyright (C) 2005 - 2023 Teunis van Beelen
+* Copyright (C) 2024 - 2024 Xael South
+*
+* Email: teuniz@protonmail.com
+*        xael.south@yandex.com
+*
+***************************************************************************
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+***************************************************************************
+*/
+
+/* 
+ * For more info and how to use this library, visit: https://github.com/xaelsouth/RS-232
+ *                                                   https://www.teuniz.net/RS-232
+ */
+
+#ifndef RS232_CODEC_H_INCLUDED
+#define RS232_CODEC_H_INCLUDED
+
+#include "rs232.h"
+
+/** SLIP (RFC 1055): frames delimited by 0xC0, 0xC0 and 0xDB escaped with 0xDB. */
+#define RS232_CODEC_SLIP  0
+
+/** COBS: zero bytes removed by overhead bytes, frames delimited by 0x00. */
+#define RS232_CODEC_COBS  1
+
+/** HDLC-like byte stuffing (RFC 1662, without FCS): frames delimited by 0x7E, 0x7E and 0x7D escaped with 0x7D and XOR 0x20. */
+#define RS232_CODEC_HDLC  2
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Gets the size an encoded frame can have at most.
+ *
+ * @param[in] codec is RS232_CODEC_SLIP, RS232_CODEC_COBS or RS232_CODEC_HDLC.
+ *
+ * @param[in] size of the data to encode in bytes.
+ *
+ * @return Size including the delimiters or 0 if the codec is unknown.
+ */
+RS232_ADDAPI size_t RS232_ADDCALL RS232_CodecMaxEncodedSize(int codec, size_t size);
+
+/**
+ * @brief Encodes data into one frame including its delimiters. Runs of bytes not to be escaped
+ *        are found with SSE2 (memchr for COBS) and copied as a whole.
+ *
+ * @param[in] codec is RS232_CODEC_SLIP, RS232_CODEC_COBS or RS232_CODEC_HDLC.
+ *
+ * @param[in] src is the data to encode.
+ *
+ * @param[in] size of src in bytes.
+ *
+ * @param[out] dst receives the frame, must not overlap src.
+ *
+ * @param[in] dst_size is the size of dst, RS232_CodecMaxEncodedSize is always enough.
+ *
+ * @return Size of the frame or -1 if dst is too small or the codec is unknown.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_CodecEncode(int codec, const void *src, size_t size, void *dst, size_t dst_size);
+
+/**
+ * @brief Decodes one frame. Delimiters at the start and the end of src are skipped.
+ *
+ * @param[in] codec is RS232_CODEC_SLIP, RS232_CODEC_COBS or RS232_CODEC_HDLC.
+ *
+ * @param[in] src is the frame.
+ *
+ * @param[in] size of src in bytes.
+ *
+ * @param[out] dst receives the data. May be equal to src to decode in place.
+ *
+ * @param[in] dst_size is the size of dst, the size of src is always enough.
+ *
+ * @return Size of the data or -1 if the frame is invalid, dst is too small or the codec is unknown.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_CodecDecode(int codec, const void *src, size_t size, void *dst, size_t dst_size);
+
+/**
+ * @brief Encodes data into one frame and writes it with a single RS232_Write.
+ *
+ * @param[in] fd file descriptor.
+ *
+ * @param[in] codec is RS232_CODEC_SLIP, RS232_CODEC_COBS or RS232_CODEC_HDLC.
+ *
+ * @param[in] buf, size, flags, timeout_msec are the same as for RS232_Write.
+ *
+ * @return size if the whole frame has been written or -1 otherwise.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_CodecWrite(RS232_FD fd, int codec, const void *buf, size_t size, int flags, int timeout_msec);
+
+/**
+ * @brief Reads one frame with RS232_RxBufferReadFrame and decodes it. Empty frames, e.g. the
+ *        opening delimiter of SLIP and HDLC, are skipped. Frames following it stay buffered.
+ *
+ * @param[in] rb receive buffer. Frames must fit into it.
+ *
+ * @param[in] codec is RS232_CODEC_SLIP, RS232_CODEC_COBS or RS232_CODEC_HDLC.
+ *
+ * @param[out] buf receives the data.
+ *
+ * @param[in] size of buf.
+ *
+ * @param[in] flags are the same as for RS232_Read.
+ *
+ * @param[in] timeout_msec is the timeout in milliseconds. 0: non-blocking, INT_MAX: blocking.
+ *
+ * @return Size of the data: > 0 on success, 0 on timeout or -1 on error, on an invalid or
+ *         a too large frame. The stream resynchronizes at the next delimiter, the rest of a
+ *         frame too large for rb is dropped.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_CodecReadFrame(RS232_RxBuffer *rb, int codec, void *buf, size_t size, int flags, int timeout_msec);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* RS232_CODEC_H_INCLUDED */
@@ -0,0 +1,896 @@
+/*
+***************************************************************************
+*
+* Author: Teunis van Beelen, Xael South
+*
+* Copyright (C) 2005 - 2023 Teunis van Beelen
+* Copyright (C) 2024 - 2024 Xael South
+*
+* Email: teuniz@protonmail.com
+*        xael.south@yandex.com
+*
+***************************************************************************
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+***************************************************************************
+*/
+
+/* 
+ * For more info and how to use this library, visit: https://github.com/xaelsouth/RS-232
+ *                                                   https://www.teuniz.net/RS-232
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include "rs232_modbus.h"
+
+/* Slice-by-8 tables: _RS232_CRCTable[k][b] is the CRC of byte b followed by k zero bytes. */
+static uint16_t _RS232_CRCTable[8][256];
+static pthread_once_t _RS232_CRCOnce = PTHREAD_ONCE_INIT;
+
+static void _RS232_CRCInit(void)
+{
+
+  for (int b = 0; b < 256; b++)
+  {
+    uint16_t crc = (uint16_t)b;
+
+    for (int bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 1) ? (uint16_t)((crc >> 1) ^ 0xA001) : (uint16_t)(crc >> 1);
+    }
+
+    _RS232_CRCTable[0][b] = crc;
+  }
+
+  for (int k = 1; k < 8; k++)
+  {
+    for (int b = 0; b < 256; b++)
+    {
+      uint16_t crc = _RS232_CRCTable[k - 1][b];
+      _RS232_CRCTable[k][b] = (uint16_t)((crc >> 8) ^ _RS232_CRCTable[0][crc & 0xFF]);
+    }
+  }
+}
+
+RS232_ADDAPI uint16_t RS232_ADDCALL RS232_ModbusCRC16(const void *data, size_t size)
+{
+
+  const uint8_t *p = data;
+  uint16_t crc = 0xFFFF;
+
+  pthread_once(&_RS232_CRCOnce, _RS232_CRCInit);
+
+  while (size >= 8)
+  {
+    crc = _RS232_CRCTable[7][(p[0] ^ crc) & 0xFF] ^
+          _RS232_CRCTable[6][(p[1] ^ (crc >> 8)) & 0xFF] ^
+          _RS232_CRCTable[5][p[2]] ^
+          _RS232_CRCTable[4][p[3]] ^
+          _RS232_CRCTable[3][p[4]] ^
+          _RS232_CRCTable[2][p[5]] ^
+          _RS232_CRCTable[1][p[6]] ^
+          _RS232_CRCTable[0][p[7]];
+
+    p += 8;
+    size -= 8;
+  }
+
+  while (size-- > 0)
+  {
+    crc = (uint16_t)((crc >> 8) ^ _RS232_CRCTable[0][(crc ^ *p++) & 0xFF]);
+  }
+
+  return crc;
+}
+
+struct RS232_Modbus
+{
+  RS232_Port *port;
+  int flags;
+  long char_usec;               /* Time of one character on the wire. */
+  long t15_usec;
+  long t35_usec;
+
+  uint8_t frame[RS232_MODBUS_MAX_ADU];    /* Frame in progress. */
+  size_t len;
+  bool in_progress;
+  bool overflow;
+  bool gap_error;
+  struct timespec last_rx;      /* Time the last data of the frame in progress has been received. */
+
+  uint8_t ready[RS232_MODBUS_MAX_ADU];    /* Last valid frame, without CRC. */
+  size_t ready_len;
+  bool ready_valid;
+
+  struct timespec last_activity;  /* End of the last frame on the bus, received or sent. */
+  RS232_ModbusStats stats;
+};
+
+static long _RS232_ElapsedUsec(const struct timespec *from, const struct timespec *to)
+{
+
+  struct timespec elapsed;
+
+  timerspecsub(to, from, &elapsed);
+
+  return (long)timespecsub_to_usec(&elapsed);
+}
+
+static void _RS232_ModbusSleepUntil(const struct timespec *deadline)
+{
+
+#if WINDOWS_BUILD == 0
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == EINTR);
+#else
+  struct timespec remaining;
+
+  if (timespec_remaining(deadline, &remaining)) Sleep((DWORD)timespec_to_msec_ceil(&remaining));
+#endif
+}
+
+RS232_ADDAPI RS232_Modbus * RS232_ADDCALL RS232_ModbusCreate(RS232_Port *port, int flags)
+{
+
+  const char *mode = RS232_PortGetMode(port);
+  int baudrate = RS232_PortGetBaudrate(port);
+
+  if (mode == NULL || baudrate <= 0) return NULL;
+
+  RS232_Modbus *mb = calloc(1, sizeof(*mb));
+  if (mb == NULL) return NULL;
+
+  /* Start bit, data bits, parity bit and stop bits. */
+  long bits = 1 + (mode[0] - '0') + ((mode[1] == 'N' || mode[1] == 'n') ? 0 : 1) + (mode[2] - '0');
+
+  mb->port = port;
+  mb->flags = flags;
+  mb->char_usec = bits * 1000000L / baudrate;
+
+  if (baudrate > 19200)
+  {
+    mb->t15_usec = 750;
+    mb->t35_usec = 1750;
+  }
+  else
+  {
+    mb->t15_usec = bits * 1500000L / baudrate;
+    mb->t35_usec = bits * 3500000L / baudrate;
+  }
+
+  return mb;
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_ModbusDestroy(RS232_Modbus *mb)
+{
+
+  free(mb);
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_ModbusGetGaps(const RS232_Modbus *mb, long *t15_usec, long *t35_usec)
+{
+
+  if (mb == NULL) return;
+
+  if (t15_usec != NULL) *t15_usec = mb->t15_usec;
+  if (t35_usec != NULL) *t35_usec = mb->t35_usec;
+}
+
+/* Ends the frame in progress: checks it and makes it the ready frame if valid. */
+static void _RS232_ModbusComplete(RS232_Modbus *mb)
+{
+
+  mb->in_progress = false;
+
+  if (mb->overflow)
+  {
+    mb->stats.overflows++;
+    return;
+  }
+
+  if (mb->gap_error && (mb->flags & RS232_MODBUS_STRICT))
+  {
+    mb->stats.gap_errors++;
+    return;
+  }
+
+  /* Address, function code and CRC at least. */
+  if (mb->len < 4 || RS232_ModbusCRC16(mb->frame, mb->len - 2) != (mb->frame[mb->len - 2] | (mb->frame[mb->len - 1] << 8)))
+  {
+    mb->stats.crc_errors++;
+    return;
+  }
+
+  if (mb->ready_valid) mb->stats.dropped++;
+
+  memcpy(mb->ready, mb->frame, mb->len - 2);
+  mb->ready_len = mb->len - 2;
+  mb->ready_valid = true;
+  mb->stats.frames++;
+}
+
+/* Silent time since the frame in progress has been received last, now being the time data of size bytes has arrived. */
+static long _RS232_ModbusSilence(const RS232_Modbus *mb, const struct timespec *now, size_t size)
+{
+
+  /* A read returns after the data has been received, take off the time it has been on the wire. */
+  long silence = _RS232_ElapsedUsec(&mb->last_rx, now) - (long)size * mb->char_usec;
+
+  return (silence > 0) ? silence : 0;
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_ModbusFeed(RS232_Modbus *mb, const void *data, size_t size, const struct timespec *now)
+{
+
+  if (mb == NULL || data == NULL || size == 0 || now == NULL) return;
+
+  if (mb->in_progress)
+  {
+    long silence = _RS232_ModbusSilence(mb, now, size);
+
+    if (silence >= mb->t35_usec)
+      _RS232_ModbusComplete(mb);
+    else if (silence > mb->t15_usec)
+      mb->gap_error = true;
+  }
+
+  if (!mb->in_progress)
+  {
+    mb->in_progress = true;
+    mb->len = 0;
+    mb->overflow = false;
+    mb->gap_error = false;
+  }
+
+  size_t room = sizeof(mb->frame) - mb->len;
+  if (size > room)
+  {
+    mb->overflow = true;
+    size = room;
+  }
+
+  memcpy(mb->frame + mb->len, data, size);
+  mb->len += size;
+  mb->last_rx = *now;
+  mb->last_activity = *now;
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_ModbusTake(RS232_Modbus *mb, const struct timespec *now, void *adu, size_t size)
+{
+
+  if (mb == NULL || now == NULL) return -1;
+
+  if (mb->in_progress && _RS232_ModbusSilence(mb, now, 0) >= mb->t35_usec) _RS232_ModbusComplete(mb);
+
+  if (!mb->ready_valid) return 0;
+
+  if (adu == NULL || size < mb->ready_len) return -1;
+
+  memcpy(adu, mb->ready, mb->ready_len);
+  mb->ready_valid = false;
+
+  return (ssize_t)mb->ready_len;
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_ModbusFrameDeadline(const RS232_Modbus *mb, struct timespec *deadline)
+{
+
+  if (mb == NULL || deadline == NULL || !mb->in_progress) return 0;
+
+  timespecadd_usec(&mb->last_rx, mb->t35_usec, deadline);
+
+  return 1;
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_ModbusReceive(RS232_Modbus *mb, void *adu, size_t size, int timeout_msec)
+{
+
+  uint8_t buf[RS232_MODBUS_MAX_ADU];
+  struct timespec deadline_buf, frame_deadline, now, remaining;
+  const struct timespec *deadline = NULL;
+
+  if (mb == NULL) return -1;
+
+  if (timeout_msec != INT_MAX)
+  {
+    timespec_deadline_usec(&deadline_buf, timeout_msec * 1000LL);
+    deadline = &deadline_buf;
+  }
+
+  for (;;)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    ssize_t len = RS232_ModbusTake(mb, &now, adu, size);
+    if (len != 0) return len;
+
+    if (deadline != NULL && !timespec_remaining(deadline, &remaining)) return 0; /* Time is up. */
+
+    /* Wake up when the frame in progress is complete, unless data keeps coming. */
+    const struct timespec *wait = deadline;
+    if (RS232_ModbusFrameDeadline(mb, &frame_deadline) && (wait == NULL || timespec_before(&frame_deadline, wait)))
+    {
+      wait = &frame_deadline;
+    }
+
+    ssize_t read_bytes = RS232_PortReadUntil(mb->port, buf, sizeof(buf), RS232_FLAGS_READSOME, wait);
+    if (read_bytes < 0) return -1;
+
+    if (read_bytes > 0)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      RS232_ModbusFeed(mb, buf, (size_t)read_bytes, &now);
+    }
+  }
+}
+
+/* Copies adu to buf and appends the CRC, buf must have room for size + 2 bytes. */
+static void _RS232_ModbusFrame(uint8_t *buf, const void *adu, size_t size)
+{
+
+  memcpy(buf, adu, size);
+
+  uint16_t crc = RS232_ModbusCRC16(buf, size);
+  buf[size] = (uint8_t)(crc & 0xFF);
+  buf[size + 1] = (uint8_t)(crc >> 8);
+}
+
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_ModbusSend(RS232_Modbus *mb, const void *adu, size_t size, int timeout_msec)
+{
+
+  uint8_t buf[RS232_MODBUS_MAX_ADU];
+  struct timespec deadline_buf, gap_end;
+  const struct timespec *deadline = NULL;
+
+  if (mb == NULL || adu == NULL || size == 0 || size > sizeof(buf) - 2) return -1;
+
+  if (timeout_msec != INT_MAX)
+  {
+    timespec_deadline_usec(&deadline_buf, timeout_msec * 1000LL);
+    deadline = &deadline_buf;
+  }
+
+  _RS232_ModbusFrame(buf, adu, size);
+
+  /* The bus must have been silent for t3.5. */
+  timespecadd_usec(&mb->last_activity, mb->t35_usec, &gap_end);
+  if (deadline != NULL && timespec_before(deadline, &gap_end)) return -1;
+  _RS232_ModbusSleepUntil(&gap_end);
+
+  /* Only what is left of the timeout after waiting for the gap. */
+  if (deadline != NULL)
+  {
+    struct timespec remaining;
+
+    if (!timespec_remaining(deadline, &remaining)) return -1;
+    timeout_msec = timespec_to_msec_ceil(&remaining);
+  }
+
+  ssize_t written_bytes = RS232_PortWrite(mb->port, buf, size + 2, 0, timeout_msec);
+  if (written_bytes != (ssize_t)(size + 2)) return -1;
+
+  /* The silent interval starts with the last bit, not with the write. */
+  if (RS232_Drain(RS232_PortFD(mb->port), deadline) != 0) return -1;
+
+  clock_gettime(CLOCK_MONOTONIC, &mb->last_activity);
+
+  return (ssize_t)size;
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_ModbusGetStats(const RS232_Modbus *mb, RS232_ModbusStats *stats)
+{
+
+  if (mb == NULL || stats == NULL) return;
+
+  *stats = mb->stats;
+}
+
+/* Merged request of RS232_ModbusScheduler, polls the jobs [first_job, first_job + job_count) of the sorted job table. */
+typedef struct
+{
+  RS232_Modbus *mb;
+  uint8_t slave;
+  uint8_t function;
+  uint16_t address;
+  uint16_t count;
+  int period_msec;
+  int timeout_msec;
+  size_t first_job;
+  size_t job_count;
+  struct timespec due;
+} _RS232_ModbusRequest;
+
+/* Port served by RS232_ModbusScheduler, has one request outstanding at a time. */
+typedef struct
+{
+  RS232_Modbus *mb;
+  _RS232_ModbusRequest *pending;
+  struct timespec response_deadline;
+  _RS232_ModbusRequest *sending;  /* Request being written, the rest is written on RS232_POLL_OUT. */
+  uint8_t tx[8];
+  size_t tx_done;
+  struct timespec tx_deadline;
+  bool tx_end;                    /* Written, RS232_PortWriteAsyncEnd hasn't returned 1 yet. */
+  struct timespec tx_end_at;      /* When to call it next. */
+} _RS232_ModbusLine;
+
+struct RS232_ModbusScheduler
+{
+  RS232_Poller *poller;
+  RS232_ModbusJobCallback callback;
+  RS232_ModbusJob *jobs;
+  size_t job_count;
+  _RS232_ModbusRequest *requests;
+  size_t request_count;
+  _RS232_ModbusLine *lines;
+  size_t line_count;
+  bool started;
+};
+
+/* Maximal amount of coils, inputs or registers a read function can request at once. */
+static unsigned _RS232_ModbusMaxCount(uint8_t function)
+{
+
+  return (function == 3 || function == 4) ? 125 : 2000;
+}
+
+/* Orders jobs so that mergeable ones are next to each other, by ascending address. */
+static int _RS232_ModbusJobCompare(const void *_a, const void *_b)
+{
+
+  const RS232_ModbusJob *a = _a, *b = _b;
+
+  if (a->mb != b->mb) return ((uintptr_t)a->mb < (uintptr_t)b->mb) ? -1 : 1;
+  if (a->slave != b->slave) return (int)a->slave - (int)b->slave;
+  if (a->function != b->function) return (int)a->function - (int)b->function;
+  if (a->period_msec != b->period_msec) return (a->period_msec < b->period_msec) ? -1 : 1;
+  if (a->timeout_msec != b->timeout_msec) return (a->timeout_msec < b->timeout_msec) ? -1 : 1;
+
+  return (int)a->address - (int)b->address;
+}
+
+static bool _RS232_ModbusMergeable(const _RS232_ModbusRequest *req, const RS232_ModbusJob *job)
+{
+
+  if (job->mb != req->mb || job->slave != req->slave || job->function != req->function ||
+      job->period_msec != req->period_msec || job->timeout_msec != req->timeout_msec) return false;
+
+  /* Jobs are sorted by address, so only the end of the request can grow. */
+  unsigned end = (unsigned)req->address + req->count;
+  if (job->address > end) return false;
+
+  if ((unsigned)job->address + job->count > end) end = (unsigned)job->address + job->count;
+
+  return end - req->address <= _RS232_ModbusMaxCount(req->function);
+}
+
+RS232_ADDAPI RS232_ModbusScheduler * RS232_ADDCALL RS232_ModbusSchedulerCreate(const RS232_ModbusJob *jobs, size_t count, RS232_ModbusJobCallback callback)
+{
+
+  if (jobs == NULL || count == 0 || callback == NULL) return NULL;
+
+  for (size_t i = 0; i < count; i++)
+  {
+    const RS232_ModbusJob *job = &jobs[i];
+
+    if (job->mb == NULL || job->function < 1 || job->function > 4 || job->count == 0 ||
+        job->count > _RS232_ModbusMaxCount(job->function) || (unsigned)job->address + job->count > 0x10000 ||
+        job->period_msec <= 0 || job->timeout_msec <= 0) return NULL;
+  }
+
+  RS232_ModbusScheduler *sched = calloc(1, sizeof(*sched));
+  if (sched == NULL) return NULL;
+
+  sched->callback = callback;
+  sched->jobs = malloc(count * sizeof(*sched->jobs));
+  sched->requests = calloc(count, sizeof(*sched->requests));
+  sched->lines = calloc(count, sizeof(*sched->lines));
+  sched->poller = RS232_PollerCreate();
+  if (sched->jobs == NULL || sched->requests == NULL || sched->lines == NULL || sched->poller == NULL) goto error;
+
+  memcpy(sched->jobs, jobs, count * sizeof(*sched->jobs));
+  sched->job_count = count;
+  qsort(sched->jobs, count, sizeof(*sched->jobs), _RS232_ModbusJobCompare);
+
+  _RS232_ModbusRequest *req = NULL;
+
+  for (size_t i = 0; i < count; i++)
+  {
+    const RS232_ModbusJob *job = &sched->jobs[i];
+
+    if (req != NULL && _RS232_ModbusMergeable(req, job))
+    {
+      if ((unsigned)job->address + job->count > (unsigned)req->address + req->count)
+      {
+        req->count = (uint16_t)(job->address + job->count - req->address);
+      }
+
+      req->job_count++;
+      continue;
+    }
+
+    req = &sched->requests[sched->request_count++];
+    req->mb = job->mb;
+    req->slave = job->slave;
+    req->function = job->function;
+    req->address = job->address;
+    req->count = job->count;
+    req->period_msec = job->period_msec;
+    req->timeout_msec = job->timeout_msec;
+    req->first_job = i;
+    req->job_count = 1;
+
+    size_t l;
+    for (l = 0; l < sched->line_count && sched->lines[l].mb != job->mb; l++);
+
+    if (l == sched->line_count)
+    {
+      _RS232_ModbusLine *line = &sched->lines[sched->line_count++];
+
+      line->mb = job->mb;
+      if (RS232_PollerAdd(sched->poller, RS232_PortFD(line->mb->port), RS232_POLL_IN, line) != 0) goto error;
+    }
+  }
+
+  return sched;
+
+error:
+  RS232_ModbusSchedulerDestroy(sched);
+  return NULL;
+}
+
+RS232_ADDAPI void RS232_ADDCALL RS232_ModbusSchedulerDestroy(RS232_ModbusScheduler *sched)
+{
+
+  if (sched == NULL) return;
+
+  if (sched->poller != NULL)
+  {
+    for (size_t l = 0; l < sched->line_count; l++)
+    {
+      RS232_PollerRemove(sched->poller, RS232_PortFD(sched->lines[l].mb->port));
+    }
+
+    RS232_PollerDestroy(sched->poller);
+  }
+
+  free(sched->lines);
+  free(sched->requests);
+  free(sched->jobs);
+  free(sched);
+}
+
+/* Passes the response to every job of the request, len is 0 on timeout. */
+static void _RS232_ModbusDispatch(RS232_ModbusScheduler *sched, const _RS232_ModbusRequest *req, const uint8_t *adu, size_t len)
+{
+
+  bool registers = (req->function == 3 || req->function == 4);
+  size_t data_size = registers ? (size_t)req->count * 2 : ((size_t)req->count + 7) / 8;
+  int status = RS232_MODBUS_TIMEOUT;
+
+  if (len == 3 && adu[1] == (req->function | 0x80))
+    status = adu[2];
+  else if (len == 3 + data_size && adu[1] == req->function && adu[2] == data_size)
+    status = 0;
+
+  for (size_t i = req->first_job; i < req->first_job + req->job_count; i++)
+  {
+    const RS232_ModbusJob *job = &sched->jobs[i];
+    unsigned offset = job->address - req->address;
+
+    if (status != 0)
+    {
+      sched->callback(job, status, NULL, 0);
+    }
+    else if (registers)
+    {
+      sched->callback(job, 0, adu + 3 + offset * 2, (size_t)job->count * 2);
+    }
+    else
+    {
+      /* Coils and inputs of the job don't start at a byte boundary within the merged response. */
+      uint8_t bits[2000 / 8];
+
+      memset(bits, 0, sizeof(bits));
+      for (unsigned bit = 0; bit < job->count; bit++)
+      {
+        unsigned from = offset + bit;
+
+        if (adu[3 + from / 8] & (1 << (from % 8))) bits[bit / 8] |= (uint8_t)(1 << (bit % 8));
+      }
+
+      sched->callback(job, 0, bits, ((size_t)job->count + 7) / 8);
+    }
+  }
+}
+
+/* Schedules the next poll of the request, missed polls are not caught up on. */
+static void _RS232_ModbusReschedule(_RS232_ModbusRequest *req, const struct timespec *now)
+{
+
+  timespecadd_usec(&req->due, req->period_msec * 1000LL, &req->due);
+  if (timespec_before(&req->due, now)) req->due = *now;
+}
+
+static void _RS232_ModbusEarlier(struct timespec *next, bool *have_next, const struct timespec *ts)
+{
+
+  if (!*have_next || timespec_before(ts, next))
+  {
+    *next = *ts;
+    *have_next = true;
+  }
+}
+
+/* Ends a request without response: sending failed or the slave didn't answer in time. */
+static void _RS232_ModbusRequestFailed(RS232_ModbusScheduler *sched, _RS232_ModbusRequest *req, const struct timespec *now)
+{
+
+  _RS232_ModbusDispatch(sched, req, NULL, 0);
+  _RS232_ModbusReschedule(req, now);
+}
+
+/*
+ * Writes what the driver takes without waiting, the rest once the port is writable again, so that
+ * one port never holds up the others. The end of transmission is derived from the baudrate.
+ */
+static int _RS232_ModbusLineWrite(RS232_ModbusScheduler *sched, _RS232_ModbusLine *line, const struct timespec *now)
+{
+
+  RS232_Modbus *mb = line->mb;
+  RS232_FD fd = RS232_PortFD(mb->port);
+  bool waiting = (line->tx_done > 0);
+
+  ssize_t written_bytes = RS232_PortWriteAsync(mb->port, line->tx + line->tx_done, sizeof(line->tx) - line->tx_done);
+  if (written_bytes < 0) return -1;
+
+  line->tx_done += (size_t)written_bytes;
+
+  if (line->tx_done < sizeof(line->tx))
+  {
+    /* The first short write starts waiting for the port to become writable. */
+    if (!waiting && RS232_PollerModify(sched->poller, fd, RS232_POLL_IN | RS232_POLL_OUT, line) != 0) return -1;
+    return 0;
+  }
+
+  if (waiting && RS232_PollerModify(sched->poller, fd, RS232_POLL_IN, line) != 0) return -1;
+
+  timespecadd_usec(now, (long long)sizeof(line->tx) * mb->char_usec, &mb->last_activity);
+  timespecadd_usec(&mb->last_activity, line->sending->timeout_msec * 1000LL, &line->response_deadline);
+
+  line->pending = line->sending;
+  line->sending = NULL;
+  line->tx_end = true;
+  line->tx_end_at = *now;
+
+  return 0;
+}
+
+/* Gives up the request being written, what has been written so far is discarded. */
+static void _RS232_ModbusWriteFailed(RS232_ModbusScheduler *sched, _RS232_ModbusLine *line, const struct timespec *now)
+{
+
+  RS232_Port *port = line->mb->port;
+  _RS232_ModbusRequest *req = line->sending;
+
+  line->sending = NULL;
+  RS232_PollerModify(sched->poller, RS232_PortFD(port), RS232_POLL_IN, line);
+  RS232_flushTX(RS232_PortFD(port));
+  RS232_PortWriteAsyncEnd(port);
+  _RS232_ModbusRequestFailed(sched, req, now);
+}
+
+static void _RS232_ModbusSendRequest(RS232_ModbusScheduler *sched, _RS232_ModbusLine *line, _RS232_ModbusRequest *req, const struct timespec *now)
+{
+
+  const uint8_t pdu[6] = { req->slave, req->function, req->address >> 8, req->address & 0xFF, req->count >> 8, req->count & 0xFF };
+
+  _RS232_ModbusFrame(line->tx, pdu, sizeof(pdu));
+
+  line->sending = req;
+  line->tx_done = 0;
+  timespecadd_usec(now, req->timeout_msec * 1000LL, &line->tx_deadline);
+
+  if (_RS232_ModbusLineWrite(sched, line, now) != 0) _RS232_ModbusWriteFailed(sched, line, now);
+}
+
+/* In software RS-485 mode RTS goes back to receive once the request has left the UART. */
+static void _RS232_ModbusLineEnd(_RS232_ModbusLine *line, const struct timespec *now, struct timespec *next, bool *have_next)
+{
+
+  if (!line->tx_end) return;
+
+  if (!timespec_before(now, &line->tx_end_at))
+  {
+    if (RS232_PortWriteAsyncEnd(line->mb->port) != 0)
+    {
+      line->tx_end = false; /* Done, or failed and the response times out. */
+      return;
+    }
+
+    /* Asked again at the estimated end of transmission, then every character. */
+    if (timespec_before(&line->tx_end_at, &line->mb->last_activity))
+      line->tx_end_at = line->mb->last_activity;
+    else
+      timespecadd_usec(now, line->mb->char_usec, &line->tx_end_at);
+  }
+
+  _RS232_ModbusEarlier(next, have_next, &line->tx_end_at);
+}
+
+/* Handles responses and timeouts of the port and sends the next due request. */
+static void _RS232_ModbusLineService(RS232_ModbusScheduler *sched, _RS232_ModbusLine *line, const struct timespec *now, struct timespec *next, bool *have_next)
+{
+
+  uint8_t adu[RS232_MODBUS_MAX_ADU];
+  struct timespec ts;
+  ssize_t len;
+
+  _RS232_ModbusLineEnd(line, now, next, have_next);
+
+  if (line->sending != NULL)
+  {
+    if (timespec_before(now, &line->tx_deadline))
+    {
+      _RS232_ModbusEarlier(next, have_next, &line->tx_deadline);
+      return;
+    }
+
+    _RS232_ModbusWriteFailed(sched, line, now);
+  }
+
+  while ((len = RS232_ModbusTake(line->mb, now, adu, sizeof(adu))) > 0)
+  {
+    _RS232_ModbusRequest *req = line->pending;
+
+    /* Frames from other slaves or for other functions are late responses or another master talking. */
+    if (req == NULL || adu[0] != req->slave || (adu[1] & 0x7F) != req->function) continue;
+
+    line->pending = NULL;
+    _RS232_ModbusDispatch(sched, req, adu, (size_t)len);
+    _RS232_ModbusReschedule(req, now);
+  }
+
+  if (line->pending != NULL)
+  {
+    if (RS232_ModbusFrameDeadline(line->mb, &ts))
+    {
+      /* A response being received is completed even if it is late. */
+      _RS232_ModbusEarlier(next, have_next, &ts);
+      return;
+    }
+
+    if (timespec_before(now, &line->response_deadline))
+    {
+      _RS232_ModbusEarlier(next, have_next, &line->response_deadline);
+      return;
+    }
+
+    _RS232_ModbusRequest *req = line->pending;
+
+    line->pending = NULL;
+    _RS232_ModbusRequestFailed(sched, req, now);
+  }
+
+  /* The bus is still ours. */
+  if (line->tx_end) return;
+
+  _RS232_ModbusRequest *req = NULL;
+
+  for (size_t i = 0; i < sched->request_count; i++)
+  {
+    _RS232_ModbusRequest *r = &sched->requests[i];
+
+    if (r->mb == line->mb && (req == NULL || timespec_before(&r->due, &req->due))) req = r;
+  }
+
+  if (req == NULL) return;
+
+  /* The bus must have been silent for t3.5. */
+  timespecadd_usec(&line->mb->last_activity, line->mb->t35_usec, &ts);
+  if (timespec_before(&ts, &req->due)) ts = req->due;
+
+  if (timespec_before(now, &ts))
+  {
+    _RS232_ModbusEarlier(next, have_next, &ts);
+    return;
+  }
+
+  _RS232_ModbusSendRequest(sched, line, req, now);
+
+  if (line->sending != NULL)
+    _RS232_ModbusEarlier(next, have_next, &line->tx_deadline);
+  else if (line->pending != NULL)
+    _RS232_ModbusEarlier(next, have_next, &line->response_deadline);
+  else
+    _RS232_ModbusEarlier(next, have_next, now); /* Failed, the next request may be due. */
+
+  _RS232_ModbusLineEnd(line, now, next, have_next);
+}
+
+RS232_ADDAPI int RS232_ADDCALL RS232_ModbusSchedulerRun(RS232_ModbusScheduler *sched, int timeout_msec)
+{
+
+  RS232_PollEvent events[16];
+  uint8_t buf[RS232_MODBUS_MAX_ADU];
+  struct timespec deadline_buf, now, next = { 0, 0 }, remaining;
+  const struct timespec *deadline = NULL;
+
+  if (sched == NULL) return -1;
+
+  if (timeout_msec != INT_MAX)
+  {
+    timespec_deadline_usec(&deadline_buf, timeout_msec * 1000LL);
+    deadline = &deadline_buf;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  if (!sched->started)
+  {
+    for (size_t i = 0; i < sched->request_count; i++)
+    {
+      sched->requests[i].due = now;
+    }
+
+    sched->started = true;
+  }
+
+  for (;;)
+  {
+    bool have_next = false;
+
+    for (size_t l = 0; l < sched->line_count; l++)
+    {
+      _RS232_ModbusLineService(sched, &sched->lines[l], &now, &next, &have_next);
+    }
+
+    if (deadline != NULL)
+    {
+      if (!timespec_remaining(deadline, &remaining)) return 0;
+      _RS232_ModbusEarlier(&next, &have_next, deadline);
+    }
+
+    int wait_msec = INT_MAX;
+    if (have_next) wait_msec = timespec_remaining(&next, &remaining) ? timespec_to_msec_ceil(&remaining) : 0;
+
+    int count = RS232_PollerWait(sched->poller, events, sizeof(events) / sizeof(events[0]), wait_msec);
+    if (count < 0) return -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (int i = 0; i < count; i++)
+    {
+      _RS232_ModbusLine *line = events[i].userdata;
+
+      if (events[i].events & RS232_POLL_ERR) return -1;
+
+      if ((events[i].events & RS232_POLL_OUT) && line->sending != NULL &&
+          _RS232_ModbusLineWrite(sched, line, &now) != 0) _RS232_ModbusWriteFailed(sched, line, &now);
+
+      if ((events[i].events & RS232_POLL_IN) == 0) continue;
+
+      ssize_t read_bytes = RS232_PortRead(line->mb->port, buf, sizeof(buf), RS232_FLAGS_READSOME, 0);
+      if (read_bytes < 0) return -1;
+
+      if (read_bytes > 0) RS232_ModbusFeed(line->mb, buf, (size_t)read_bytes, &now);
+    }
+  }
+}
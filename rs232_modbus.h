@@ -0,0 +1,261 @@
+/*
+***************************************************************************
+*
+* Author: Teunis van Beelen, Xael South
+*
+* Copyright (C) 2005 - 2023 Teunis van Beelen
+* Copyright (C) 2024 - 2024 Xael South
+*
+* Email: teuniz@protonmail.com
+*        xael.south@yandex.com
+*
+***************************************************************************
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+***************************************************************************
+*/
+
+/* 
+ * For more info and how to use this library, visit: https://github.com/xaelsouth/RS-232
+ *                                                   https://www.teuniz.net/RS-232
+ */
+
+#ifndef RS232_MODBUS_H_INCLUDED
+#define RS232_MODBUS_H_INCLUDED
+
+#include "rs232.h"
+
+/** Maximal size of a Modbus RTU frame: address, PDU and CRC. */
+#define RS232_MODBUS_MAX_ADU  256
+
+/** RS232_ModbusCreate: frames with a silent interval longer than t1.5 between two characters are dropped. */
+#define RS232_MODBUS_STRICT   (1 << 0)
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Modbus RTU framing on top of a port, see RS232_ModbusCreate. */
+typedef struct RS232_Modbus RS232_Modbus;
+
+/** Counters of the receiver. */
+typedef struct
+{
+  uint64_t frames;            /**< Valid frames received. */
+  uint64_t crc_errors;        /**< Frames dropped because of a wrong CRC or being too short. */
+  uint64_t gap_errors;        /**< Frames dropped because of a gap longer than t1.5 (RS232_MODBUS_STRICT only). */
+  uint64_t overflows;         /**< Frames dropped because of being longer than RS232_MODBUS_MAX_ADU. */
+  uint64_t dropped;           /**< Valid frames overwritten by the next one before being taken. */
+} RS232_ModbusStats;
+
+/**
+ * @brief Computes the Modbus CRC-16 (polynomial 0xA001, initial value 0xFFFF), 8 bytes per step.
+ *
+ * @param[in] data to compute the CRC of.
+ *
+ * @param[in] size of data in bytes.
+ *
+ * @return CRC, sent low byte first.
+ */
+RS232_ADDAPI uint16_t RS232_ADDCALL RS232_ModbusCRC16(const void *data, size_t size);
+
+/**
+ * @brief Creates the Modbus RTU framing for a port. The silent intervals t1.5 and t3.5 are
+ *        derived from the baudrate and mode of the port: 1.5 and 3.5 character times, fixed
+ *        to 750 and 1750 microseconds above 19200 baud as the specification recommends.
+ *
+ * @param[in] port created by RS232_PortOpen, must outlive the framing.
+ *
+ * @param[in] flags can be RS232_MODBUS_STRICT or 0.
+ *
+ * @return Modbus framing or NULL on error.
+ */
+RS232_ADDAPI RS232_Modbus * RS232_ADDCALL RS232_ModbusCreate(RS232_Port *port, int flags);
+
+/**
+ * @brief Destroys the framing, the port is not closed.
+ *
+ * @param[in] mb created by RS232_ModbusCreate.
+ */
+RS232_ADDAPI void RS232_ADDCALL RS232_ModbusDestroy(RS232_Modbus *mb);
+
+/**
+ * @brief Gets the silent intervals in use.
+ *
+ * @param[in] mb created by RS232_ModbusCreate.
+ *
+ * @param[out] t15_usec receives t1.5 in microseconds.
+ *
+ * @param[out] t35_usec receives t3.5 in microseconds.
+ */
+RS232_ADDAPI void RS232_ADDCALL RS232_ModbusGetGaps(const RS232_Modbus *mb, long *t15_usec, long *t35_usec);
+
+/**
+ * @brief Feeds received data into the framing. A silent interval of at least t3.5 since the
+ *        previous data completes the frame received so far. For event loops reading the port themselves.
+ *
+ * @param[in] mb created by RS232_ModbusCreate.
+ *
+ * @param[in] data received.
+ *
+ * @param[in] size of data in bytes.
+ *
+ * @param[in] now is the CLOCK_MONOTONIC time the data has been received at.
+ */
+RS232_ADDAPI void RS232_ADDCALL RS232_ModbusFeed(RS232_Modbus *mb, const void *data, size_t size, const struct timespec *now);
+
+/**
+ * @brief Takes a complete and valid frame, if any.
+ *
+ * @param[in] mb created by RS232_ModbusCreate.
+ *
+ * @param[in] now is the current CLOCK_MONOTONIC time, completes the frame in progress if t3.5 has passed.
+ *
+ * @param[out] adu receives address and PDU, without CRC.
+ *
+ * @param[in] size of adu, RS232_MODBUS_MAX_ADU - 2 is always enough.
+ *
+ * @return Size of the frame, 0 if there is none or -1 if adu is too small.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_ModbusTake(RS232_Modbus *mb, const struct timespec *now, void *adu, size_t size);
+
+/**
+ * @brief Gets the time the frame in progress will be complete at if nothing more is received.
+ *
+ * @param[in] mb created by RS232_ModbusCreate.
+ *
+ * @param[out] deadline receives the CLOCK_MONOTONIC time.
+ *
+ * @return 1 if a frame is in progress or 0 otherwise.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_ModbusFrameDeadline(const RS232_Modbus *mb, struct timespec *deadline);
+
+/**
+ * @brief Receives a frame: reads the port and feeds the framing until a valid frame is complete.
+ *
+ * @param[in] mb created by RS232_ModbusCreate.
+ *
+ * @param[out] adu receives address and PDU, without CRC.
+ *
+ * @param[in] size of adu.
+ *
+ * @param[in] timeout_msec is the timeout in milliseconds. INT_MAX: wait forever.
+ *
+ * @return Size of the frame, 0 on timeout or -1 on error.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_ModbusReceive(RS232_Modbus *mb, void *adu, size_t size, int timeout_msec);
+
+/**
+ * @brief Sends a frame: waits until the bus has been silent for t3.5, appends the CRC and writes
+ *        it. Returns once the frame has been transmitted, so that the silent interval after it
+ *        is measured from the last bit.
+ *
+ * @param[in] mb created by RS232_ModbusCreate.
+ *
+ * @param[in] adu is address and PDU, without CRC.
+ *
+ * @param[in] size of adu, up to RS232_MODBUS_MAX_ADU - 2.
+ *
+ * @param[in] timeout_msec is the timeout in milliseconds. INT_MAX: wait forever.
+ *
+ * @return Size of adu if sent or -1 on error or timeout.
+ */
+RS232_ADDAPI ssize_t RS232_ADDCALL RS232_ModbusSend(RS232_Modbus *mb, const void *adu, size_t size, int timeout_msec);
+
+/**
+ * @brief Gets the counters of the receiver.
+ *
+ * @param[in] mb created by RS232_ModbusCreate.
+ *
+ * @param[out] stats receives the counters.
+ */
+RS232_ADDAPI void RS232_ADDCALL RS232_ModbusGetStats(const RS232_Modbus *mb, RS232_ModbusStats *stats);
+
+/** Scheduler callback status: no or no valid response before the timeout. */
+#define RS232_MODBUS_TIMEOUT  (-1)
+
+/** Periodic read job of RS232_ModbusScheduler. */
+typedef struct
+{
+  RS232_Modbus *mb;           /**< Framing of the port the slave is connected to. */
+  uint8_t slave;              /**< Slave address, 1 to 247. */
+  uint8_t function;           /**< Read function: 1 (coils), 2 (discrete inputs), 3 (holding registers) or 4 (input registers). */
+  uint16_t address;           /**< First coil, input or register. */
+  uint16_t count;             /**< Amount of coils, inputs or registers. */
+  int period_msec;            /**< Poll period in milliseconds. */
+  int timeout_msec;           /**< Response timeout of the slave in milliseconds. */
+  void *userdata;             /**< Passed to the callback. */
+} RS232_ModbusJob;
+
+/**
+ * @brief Called by RS232_ModbusSchedulerRun once a job has been polled.
+ *
+ * @param[in] job the response belongs to.
+ *
+ * @param[in] status is 0 on success, a Modbus exception code (> 0) or RS232_MODBUS_TIMEOUT.
+ *
+ * @param[in] data of the job only, as in the response: registers big endian, coils and inputs
+ *            packed LSB first. NULL unless status is 0.
+ *
+ * @param[in] size of data in bytes.
+ */
+typedef void (*RS232_ModbusJobCallback)(const RS232_ModbusJob *job, int status, const uint8_t *data, size_t size);
+
+/** Modbus master polling many slaves on many ports, see RS232_ModbusSchedulerCreate. */
+typedef struct RS232_ModbusScheduler RS232_ModbusScheduler;
+
+/**
+ * @brief Creates a scheduler polling the given jobs. Jobs on the same port and slave with the same
+ *        function, period and timeout whose ranges overlap or are adjacent are merged into one
+ *        request as long as it fits the limits of the function (125 registers or 2000 bits).
+ *        Every port has one request outstanding at a time, the ports are served concurrently.
+ * @note  Uses RS232_Poller, so not supported on Windows.
+ *
+ * @param[in] jobs to poll, copied.
+ *
+ * @param[in] count of jobs.
+ *
+ * @param[in] callback is called for every job once its response has been received or timed out.
+ *
+ * @return Scheduler or NULL on error.
+ */
+RS232_ADDAPI RS232_ModbusScheduler * RS232_ADDCALL RS232_ModbusSchedulerCreate(const RS232_ModbusJob *jobs, size_t count, RS232_ModbusJobCallback callback);
+
+/**
+ * @brief Destroys the scheduler. Ports and framings are left untouched.
+ *
+ * @param[in] sched created by RS232_ModbusSchedulerCreate.
+ */
+RS232_ADDAPI void RS232_ADDCALL RS232_ModbusSchedulerDestroy(RS232_ModbusScheduler *sched);
+
+/**
+ * @brief Runs the scheduler: sends due requests, receives responses and calls the callback.
+ *        All jobs are due on the first run. Requests are written with RS232_PortWriteAsync,
+ *        the rest on RS232_POLL_OUT, so no port waits for another one;
+ *        in software RS-485 mode RTS is switched back without waiting either.
+ *
+ * @param[in] sched created by RS232_ModbusSchedulerCreate.
+ *
+ * @param[in] timeout_msec is the time to run in milliseconds. INT_MAX: run forever.
+ *
+ * @return 0 once the time has passed or -1 on error.
+ */
+RS232_ADDAPI int RS232_ADDCALL RS232_ModbusSchedulerRun(RS232_ModbusScheduler *sched, int timeout_msec);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* RS232_MODBUS_H_INCLUDED */
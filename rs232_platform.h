@@ -60,6 +60,12 @@ typedef _W64 int ssize_t;
 
 typedef HANDLE RS232_FD;
 
+typedef struct
+{
+  void *iov_base;
+  size_t iov_len;
+} RS232_IOVec;
+
 #define RS232_INVALID_FD    INVALID_HANDLE_VALUE
 
 #define msleep(msecs) Sleep(msecs)
@@ -70,6 +76,7 @@ typedef HANDLE RS232_FD;
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/file.h>
+#include <sys/uio.h>
 #include <errno.h>
 
 #define RS232_ADDAPI
@@ -77,6 +84,8 @@ typedef HANDLE RS232_FD;
 
 typedef int RS232_FD;
 
+typedef struct iovec RS232_IOVec;
+
 #define RS232_INVALID_FD    -1
 
 #define msleep(msecs) usleep(msecs*1000)
@@ -100,4 +109,65 @@ static inline long timespecsub_to_msec(const struct timespec *ts)
   return (long)(ts->tv_sec * 1000L + ts->tv_nsec / 1000000L);
 }
 
+static inline long long timespecsub_to_usec(const struct timespec *ts)
+{
+
+  return (long long)ts->tv_sec * 1000000LL + ts->tv_nsec / 1000L;
+}
+
+/* Rounds up so that a non-zero timeout never becomes a zero one. Saturates at INT_MAX. */
+static inline int timespec_to_msec_ceil(const struct timespec *ts)
+{
+
+  long long msec = (long long)ts->tv_sec * 1000LL + (ts->tv_nsec + 999999L) / 1000000L;
+
+  return (msec > 0x7FFFFFFFLL) ? 0x7FFFFFFF : (int)msec;
+}
+
+static inline int timespec_before(const struct timespec *a, const struct timespec *b)
+{
+
+  return (a->tv_sec < b->tv_sec) || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static inline void timespecadd_usec(const struct timespec *a, long long usec, struct timespec *result)
+{
+
+  result->tv_sec  = a->tv_sec  + (time_t)(usec / 1000000LL);
+  result->tv_nsec = a->tv_nsec + (long)(usec % 1000000LL) * 1000L;
+  if (result->tv_nsec >= 1000000000L)
+  {
+    ++result->tv_sec;
+    result->tv_nsec -= 1000000000L;
+  }
+}
+
+/* Sets deadline to usec microseconds from now on the CLOCK_MONOTONIC clock. */
+static inline void timespec_deadline_usec(struct timespec *deadline, long long usec)
+{
+
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  timespecadd_usec(&now, (usec > 0) ? usec : 0, deadline);
+}
+
+/* Stores the time left until deadline in remaining. Returns 0 if the deadline has passed, 1 otherwise. */
+static inline int timespec_remaining(const struct timespec *deadline, struct timespec *remaining)
+{
+
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  timerspecsub(deadline, &now, remaining);
+  if (remaining->tv_sec < 0 || (remaining->tv_sec == 0 && remaining->tv_nsec == 0))
+  {
+    remaining->tv_sec = 0;
+    remaining->tv_nsec = 0;
+    return 0;
+  }
+
+  return 1;
+}
+
 #endif /* RS232_PLATFORM_H_INCLUDED */
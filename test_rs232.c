@@ -4,7 +4,7 @@ file: test_rs232.c
 purpose: Simple demo that implements multiple unit tests.
          Use null-modem cable to run it.
 
-Compile with the command: gcc test_rs232.c rs232.c -Wall -Wextra -o test_rs232
+Compile with the command: gcc test_rs232.c rs232.c rs232_modbus.c rs232_codec.c -Wall -Wextra -pthread -o test_rs232
 
 **************************************************/
 
@@ -14,7 +14,13 @@ Compile with the command: gcc test_rs232.c rs232.c -Wall -Wextra -o test_rs232
 #include <stdio.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <errno.h>
+#if defined(__linux__)
+#include <signal.h>
+#endif
 #include "rs232.h"
+#include "rs232_codec.h"
+#include "rs232_modbus.h"
 
 #if defined(NDEBUG)
 #define my_assert(expr) do { if (!(expr)) abort(); } while(0)
@@ -34,134 +40,1393 @@ Compile with the command: gcc test_rs232.c rs232.c -Wall -Wextra -o test_rs232
 static RS232_FD try_RS232_Open(const char *devname, int baudrate, const char *mode, int flags)
 {
 
-  int attempts = 15;
+  int attempts = 15;
+
+  RS232_FD fd = RS232_Open(devname, baudrate, mode, flags);
+
+  while (fd == RS232_INVALID_FD && attempts--)
+  {
+    msleep(1000);
+    fd = RS232_Open(devname, baudrate, mode, flags);
+  }
+
+  return fd;
+}
+
+static void test_open_fail_fast(void)
+{
+
+  RS232_OpenOptions options;
+  struct timespec deadline, remaining;
+
+  RS232_OpenOptionsInit(&options);
+  options.max_attempts = 1;
+
+  timespec_deadline_usec(&deadline, 500000);
+
+  RS232_FD fd = RS232_OpenEx("/dev/does-not-exist", 115200, "8N1", 0, &options);
+  my_assert(fd == RS232_INVALID_FD);
+
+  /* Must not have retried. */
+  my_assert(timespec_remaining(&deadline, &remaining) == 1);
+
+  my_assert(RS232_OpenOptionsInit(NULL) == -1);
+
+  /* Invalid arguments are not retried, even with the default policy of up to 16 attempts. */
+  timespec_deadline_usec(&deadline, 500000);
+
+  fd = RS232_OpenEx("/dev/does-not-exist", 115200, "8X1", 0, NULL);
+  my_assert(fd == RS232_INVALID_FD);
+#if WINDOWS_BUILD == 0
+  my_assert(errno == EINVAL);
+#endif
+
+  fd = RS232_OpenEx(NULL, 115200, "8N1", 0, NULL);
+  my_assert(fd == RS232_INVALID_FD);
+
+  /* Nor is a missing device if the policy says so. */
+  RS232_OpenOptionsInit(&options);
+  options.retry_missing = 0;
+
+  fd = RS232_OpenEx("/dev/does-not-exist", 115200, "8N1", 0, &options);
+  my_assert(fd == RS232_INVALID_FD);
+
+  my_assert(timespec_remaining(&deadline, &remaining) == 1);
+}
+
+static void test_write_read_256bytes(RS232_FD src, RS232_FD dst)
+{
+
+  int flags = 0, timeout_msec = 1000, err;
+  ssize_t written_bytes, read_bytes;
+  uint8_t tx_buf[256], rx_buf[256];
+
+  for (size_t i = 0; i < sizeof(tx_buf); i++)
+  {
+    tx_buf[i] = i;
+    rx_buf[i] = 0;
+  }
+
+  err = RS232_flushRXTX(src);
+  my_assert(err == 0);
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+
+  written_bytes = RS232_Write(src, tx_buf, sizeof(tx_buf), flags, timeout_msec);
+  my_assert(written_bytes == sizeof(tx_buf));
+
+  read_bytes = RS232_Read(dst, rx_buf, sizeof(rx_buf), flags, timeout_msec);
+  my_assert(read_bytes == (ssize_t)sizeof(rx_buf));
+
+  for (ssize_t i = 0; i < read_bytes; i++)
+  {
+    my_assert(tx_buf[i] == rx_buf[i]);
+  }
+}
+
+static void test_write_read_256bytes_nonblocking(RS232_FD src, RS232_FD dst)
+{
+
+  int flags = 0, timeout_msec = 0, err;
+  ssize_t written_bytes, read_bytes;
+  uint8_t tx_buf[256], rx_buf[256];
+
+  for (size_t i = 0; i < sizeof(tx_buf); i++)
+  {
+    tx_buf[i] = i;
+    rx_buf[i] = 0;
+  }
+
+  err = RS232_flushRXTX(src);
+  my_assert(err == 0);
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+
+  written_bytes = RS232_Write(src, tx_buf, sizeof(tx_buf), flags, timeout_msec);
+  my_assert(written_bytes == sizeof(tx_buf));
+
+  read_bytes = RS232_Read(dst, rx_buf, sizeof(rx_buf), flags, timeout_msec);
+  my_assert(read_bytes <= (ssize_t)sizeof(rx_buf) && read_bytes >= 0);
+
+  for (ssize_t i = 0; i < read_bytes; i++)
+  {
+    my_assert(tx_buf[i] == rx_buf[i]);
+  }
+}
+
+static void test_write_read_some(RS232_FD src, RS232_FD dst)
+{
+
+  int flags = 0, timeout_msec = 1000, err;
+  ssize_t written_bytes, read_bytes;
+  uint8_t tx_buf[16], rx_buf[256];
+
+  for (size_t i = 0; i < sizeof(tx_buf); i++)
+  {
+    tx_buf[i] = i;
+  }
+
+  err = RS232_flushRXTX(src);
+  my_assert(err == 0);
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+
+  written_bytes = RS232_Write(src, tx_buf, sizeof(tx_buf), flags, timeout_msec);
+  my_assert(written_bytes == sizeof(tx_buf));
+
+  /* Must not wait for the whole buffer to be filled. */
+  read_bytes = RS232_ReadSome(dst, rx_buf, sizeof(rx_buf), sizeof(tx_buf), flags, timeout_msec, 0);
+  my_assert(read_bytes == (ssize_t)sizeof(tx_buf));
+
+  for (ssize_t i = 0; i < read_bytes; i++)
+  {
+    my_assert(tx_buf[i] == rx_buf[i]);
+  }
+
+  written_bytes = RS232_Write(src, tx_buf, sizeof(tx_buf), flags, timeout_msec);
+  my_assert(written_bytes == sizeof(tx_buf));
+
+  read_bytes = RS232_Read(dst, rx_buf, sizeof(rx_buf), RS232_FLAGS_READSOME, timeout_msec);
+  my_assert(read_bytes > 0 && read_bytes <= (ssize_t)sizeof(tx_buf));
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+}
+
+static void test_read_until_deadline(RS232_FD src, RS232_FD dst)
+{
+
+  int flags = 0, err;
+  ssize_t read_bytes;
+  uint8_t rx_buf[16];
+  struct timespec deadline, remaining;
+  (void)src;
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+
+  /* Nothing is sent: read must return after 500 microseconds, well before 50 milliseconds are over. */
+  timespec_deadline_usec(&deadline, 500);
+  read_bytes = RS232_ReadUntil(dst, rx_buf, sizeof(rx_buf), flags, &deadline);
+  my_assert(read_bytes == 0);
+  my_assert(timespec_remaining(&deadline, &remaining) == 0);
+
+  timespec_deadline_usec(&deadline, 50000);
+  my_assert(timespec_remaining(&deadline, &remaining) == 1);
+}
+
+static void test_drain(RS232_FD src, RS232_FD dst)
+{
+
+  int flags = 0, timeout_msec = 1000, err;
+  ssize_t written_bytes, read_bytes;
+  uint8_t tx_buf[64] = { 0 }, rx_buf[64];
+  struct timespec deadline;
+
+  err = RS232_flushRXTX(src);
+  my_assert(err == 0);
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+
+  written_bytes = RS232_Write(src, tx_buf, sizeof(tx_buf), flags, timeout_msec);
+  my_assert(written_bytes == (ssize_t)sizeof(tx_buf));
+
+  timespec_deadline_usec(&deadline, 1000000);
+  err = RS232_Drain(src, &deadline);
+  my_assert(err == 0);
+  my_assert(RS232_BytesPending(src) == 0);
+
+  /* Everything is on the wire, wait for the last byte to be received. */
+  read_bytes = RS232_Read(dst, rx_buf, 1, flags, timeout_msec);
+  my_assert(read_bytes == 1);
+  my_assert(RS232_BytesAvailable(dst) <= (int)sizeof(tx_buf) - 1);
+
+  read_bytes = RS232_Read(dst, rx_buf, sizeof(rx_buf) - 1, flags, timeout_msec);
+  my_assert(read_bytes == (ssize_t)sizeof(rx_buf) - 1);
+  my_assert(RS232_BytesAvailable(dst) == 0);
+}
+
+static void test_kernel_timeout(RS232_FD src, RS232_FD dst)
+{
+
+  int timeout_msec = 1000, err;
+  ssize_t written_bytes, read_bytes;
+  uint8_t tx_buf[16], rx_buf[16];
+
+  for (size_t i = 0; i < sizeof(tx_buf); i++)
+  {
+    tx_buf[i] = i;
+    rx_buf[i] = 0;
+  }
+
+  err = RS232_flushRXTX(src);
+  my_assert(err == 0);
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+
+  /* Set VMIN/VTIME must not make the flag block beyond its deadline. */
+  err = RS232_SetReadTimeouts(dst, sizeof(rx_buf), 100);
+  my_assert(err == 0);
+
+  written_bytes = RS232_Write(src, tx_buf, sizeof(tx_buf), 0, timeout_msec);
+  my_assert(written_bytes == sizeof(tx_buf));
+
+  read_bytes = RS232_Read(dst, rx_buf, sizeof(rx_buf), RS232_FLAGS_KERNELTIMEOUT, timeout_msec);
+  my_assert(read_bytes == (ssize_t)sizeof(rx_buf));
+
+  for (ssize_t i = 0; i < read_bytes; i++)
+  {
+    my_assert(tx_buf[i] == rx_buf[i]);
+  }
+
+#if WINDOWS_BUILD == 0
+  /* A silent line times out at the deadline, also if it isn't a multiple of VTIME's 100 ms. */
+  struct timespec start, end, elapsed;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  read_bytes = RS232_Read(dst, rx_buf, sizeof(rx_buf), RS232_FLAGS_KERNELTIMEOUT, 250);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  my_assert(read_bytes == 0);
+
+  timerspecsub(&end, &start, &elapsed);
+  my_assert(timespecsub_to_msec(&elapsed) >= 240 && timespecsub_to_msec(&elapsed) < 400);
+
+  /* Plain reads and writes on dst keep their deadlines. */
+  my_assert(fcntl(dst, F_GETFL) & O_NONBLOCK);
+#endif
+
+  err = RS232_SetReadTimeouts(dst, 0, 0);
+  my_assert(err == 0);
+}
+
+static void test_reconfigure(RS232_FD src, RS232_FD dst)
+{
+
+  int err;
+
+  err = RS232_Reconfigure(src, 57600, "8E1", RS232_FLAGS_DRAIN);
+  my_assert(err == 0);
+
+  err = RS232_Reconfigure(dst, 57600, "8E1", 0);
+  my_assert(err == 0);
+
+  my_assert(RS232_GetBaudrate(src) == 57600);
+  my_assert(RS232_GetBaudrate(dst) == 57600);
+
+  test_write_read_256bytes(src, dst);
+
+  err = RS232_Reconfigure(src, 115200, "8N1", RS232_FLAGS_DRAIN);
+  my_assert(err == 0);
+
+  err = RS232_Reconfigure(dst, 115200, "8N1", 0);
+  my_assert(err == 0);
+
+  test_write_read_256bytes(src, dst);
+}
+
+static void test_rx_buffer(RS232_FD src, RS232_FD dst)
+{
+
+  int flags = 0, timeout_msec = 1000, err;
+  ssize_t written_bytes, read_bytes;
+  uint8_t tx_buf[256];
+  size_t received = 0;
+
+  for (size_t i = 0; i < sizeof(tx_buf); i++)
+  {
+    tx_buf[i] = i;
+  }
+
+  err = RS232_flushRXTX(src);
+  my_assert(err == 0);
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+
+  RS232_RxBuffer *rb = RS232_RxBufferCreate(dst, 64);
+  my_assert(rb != NULL);
+
+  written_bytes = RS232_Write(src, tx_buf, sizeof(tx_buf), flags, timeout_msec);
+  my_assert(written_bytes == sizeof(tx_buf));
+
+  while (received < sizeof(tx_buf))
+  {
+    const void *data;
+    size_t len;
+
+    read_bytes = RS232_RxBufferFill(rb, flags, timeout_msec);
+    my_assert(read_bytes >= 0);
+
+    err = RS232_RxBufferPeek(rb, &data, &len);
+    my_assert(err == 0);
+    my_assert(len > 0 && len <= 64);
+
+    /* Check the data in place, as a parser would do, then consume all of it at once. */
+    for (size_t i = 0; i < len; i++)
+    {
+      my_assert(((const uint8_t *)data)[i] == tx_buf[received + i]);
+    }
+
+    err = RS232_RxBufferConsume(rb, len);
+    my_assert(err == 0);
+
+    received += len;
+  }
+
+  RS232_RxBufferDestroy(rb);
+
+  /* A tiny buffer must compact even though its free space never drops below a quarter. */
+  const void *frame;
+
+  rb = RS232_RxBufferCreate(dst, 3);
+  my_assert(rb != NULL);
+
+  written_bytes = RS232_Write(src, "a\nbcd\n", 6, flags, timeout_msec);
+  my_assert(written_bytes == 6);
+
+  read_bytes = RS232_RxBufferReadFrame(rb, "\n", 1, flags, timeout_msec, &frame);
+  my_assert(read_bytes == 2 && memcmp(frame, "a\n", 2) == 0);
+
+  read_bytes = RS232_RxBufferReadFrame(rb, "\n", 1, flags, timeout_msec, &frame);
+  my_assert(read_bytes == 3 && memcmp(frame, "bcd", 3) == 0);
+
+  read_bytes = RS232_RxBufferReadFrame(rb, "\n", 1, flags, timeout_msec, &frame);
+  my_assert(read_bytes == 1 && memcmp(frame, "\n", 1) == 0);
+
+  RS232_RxBufferDestroy(rb);
+}
+
+static void test_read_frame(RS232_FD src, RS232_FD dst)
+{
+
+  int flags = 0, timeout_msec = 1000, err;
+  ssize_t written_bytes, frame_len;
+  const char tx_buf[] = "first\nsecond\nthird\x03";
+  const void *frame;
+
+  err = RS232_flushRXTX(src);
+  my_assert(err == 0);
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+
+  RS232_RxBuffer *rb = RS232_RxBufferCreate(dst, 256);
+  my_assert(rb != NULL);
+
+  written_bytes = RS232_Write(src, tx_buf, strlen(tx_buf), flags, timeout_msec);
+  my_assert(written_bytes == (ssize_t)strlen(tx_buf));
+
+  frame_len = RS232_RxBufferReadFrame(rb, "\n\x03", 2, flags, timeout_msec, &frame);
+  my_assert(frame_len == 6 && memcmp(frame, "first\n", 6) == 0);
+
+  frame_len = RS232_RxBufferReadFrame(rb, "\n\x03", 2, flags, timeout_msec, &frame);
+  my_assert(frame_len == 7 && memcmp(frame, "second\n", 7) == 0);
+
+  frame_len = RS232_RxBufferReadFrame(rb, "\n\x03", 2, flags, timeout_msec, &frame);
+  my_assert(frame_len == 6 && memcmp(frame, "third\x03", 6) == 0);
+
+  /* Nothing left. */
+  frame_len = RS232_RxBufferReadFrame(rb, "\n\x03", 2, flags, 10, &frame);
+  my_assert(frame_len == 0);
+
+  RS232_RxBufferDestroy(rb);
+}
+
+static void test_codec(void)
+{
+
+  uint8_t data[600], frame[1300], decoded[600];
+  const uint8_t special[] = { 0x00, 0x7D, 0x7E, 0xC0, 0xDB, 0xDC, 0xDD };
+
+  for (size_t i = 0; i < sizeof(data); i++)
+  {
+    /* Plain runs longer than a COBS block and a SSE2 vector, mixed with bytes to escape. */
+    data[i] = (i % 97 < 7) ? special[i % 97] : (uint8_t)(i % 255 + 1);
+  }
+
+  for (int codec = RS232_CODEC_SLIP; codec <= RS232_CODEC_HDLC; codec++)
+  {
+    for (size_t size = 0; size <= sizeof(data); size += (size < 20) ? 1 : 97)
+    {
+      ssize_t frame_len = RS232_CodecEncode(codec, data, size, frame, RS232_CodecMaxEncodedSize(codec, size));
+      my_assert(frame_len >= 2);
+
+      ssize_t len = RS232_CodecDecode(codec, frame, frame_len, decoded, sizeof(decoded));
+      my_assert(len == (ssize_t)size);
+      my_assert(memcmp(data, decoded, size) == 0);
+    }
+  }
+
+  /* Test vectors: COBS 11 22 00 33, SLIP C0 DB and an invalid SLIP escape. */
+  my_assert(RS232_CodecEncode(RS232_CODEC_COBS, "\x11\x22\x00\x33", 4, frame, sizeof(frame)) == 6);
+  my_assert(memcmp(frame, "\x03\x11\x22\x02\x33\x00", 6) == 0);
+
+  my_assert(RS232_CodecEncode(RS232_CODEC_SLIP, "\xC0\xDB", 2, frame, sizeof(frame)) == 6);
+  my_assert(memcmp(frame, "\xC0\xDB\xDC\xDB\xDD\xC0", 6) == 0);
+
+  my_assert(RS232_CodecDecode(RS232_CODEC_SLIP, "\xC0\x01\xDB\x02\xC0", 5, decoded, sizeof(decoded)) == -1);
+}
+
+static void test_codec_read_write(RS232_FD src, RS232_FD dst)
+{
+
+  int flags = 0, timeout_msec = 1000;
+  ssize_t len;
+  uint8_t tx_buf[] = { 0x01, 0xC0, 0x00, 0x7E, 0x7D, 0xDB, 0x02 };
+  uint8_t rx_buf[64], large_buf[300];
+
+  memset(large_buf, 'A', sizeof(large_buf));
+
+  RS232_RxBuffer *rb = RS232_RxBufferCreate(dst, 256);
+  my_assert(rb != NULL);
+
+  for (int codec = RS232_CODEC_SLIP; codec <= RS232_CODEC_HDLC; codec++)
+  {
+    /* Two frames back to back, the second one stays buffered. */
+    len = RS232_CodecWrite(src, codec, tx_buf, sizeof(tx_buf), flags, timeout_msec);
+    my_assert(len == (ssize_t)sizeof(tx_buf));
+
+    len = RS232_CodecWrite(src, codec, tx_buf, 3, flags, timeout_msec);
+    my_assert(len == 3);
+
+    len = RS232_CodecReadFrame(rb, codec, rx_buf, sizeof(rx_buf), flags, timeout_msec);
+    my_assert(len == (ssize_t)sizeof(tx_buf));
+    my_assert(memcmp(tx_buf, rx_buf, sizeof(tx_buf)) == 0);
+
+    len = RS232_CodecReadFrame(rb, codec, rx_buf, sizeof(rx_buf), flags, timeout_msec);
+    my_assert(len == 3);
+    my_assert(memcmp(tx_buf, rx_buf, 3) == 0);
+
+    len = RS232_CodecReadFrame(rb, codec, rx_buf, sizeof(rx_buf), flags, 100);
+    my_assert(len == 0);
+
+    /* A frame larger than the buffer is dropped as a whole, the frame after it is intact. */
+    len = RS232_CodecWrite(src, codec, large_buf, sizeof(large_buf), flags, timeout_msec);
+    my_assert(len == (ssize_t)sizeof(large_buf));
+
+    len = RS232_CodecWrite(src, codec, tx_buf, 3, flags, timeout_msec);
+    my_assert(len == 3);
+
+    len = RS232_CodecReadFrame(rb, codec, rx_buf, sizeof(rx_buf), flags, timeout_msec);
+    my_assert(len == -1);
+
+    len = RS232_CodecReadFrame(rb, codec, rx_buf, sizeof(rx_buf), flags, timeout_msec);
+    my_assert(len == 3);
+    my_assert(memcmp(tx_buf, rx_buf, 3) == 0);
+  }
+
+  RS232_RxBufferDestroy(rb);
+}
+
+static void test_writev_readv(RS232_FD src, RS232_FD dst)
+{
+
+  int flags = 0, timeout_msec = 1000, err;
+  ssize_t written_bytes, read_bytes;
+  uint8_t header[4] = { 0x7E, 0x01, 0x02, 0x03 }, payload[100], trailer[2] = { 0xAA, 0x55 };
+  uint8_t rx_header[4], rx_payload[100], rx_trailer[2];
+
+  for (size_t i = 0; i < sizeof(payload); i++)
+  {
+    payload[i] = i;
+  }
+
+  RS232_IOVec tx_iov[3] = { { header, sizeof(header) }, { payload, sizeof(payload) }, { trailer, sizeof(trailer) } };
+  RS232_IOVec rx_iov[3] = { { rx_header, sizeof(rx_header) }, { rx_payload, sizeof(rx_payload) }, { rx_trailer, sizeof(rx_trailer) } };
+
+  err = RS232_flushRXTX(src);
+  my_assert(err == 0);
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+
+  written_bytes = RS232_Writev(src, tx_iov, 3, flags, timeout_msec);
+  my_assert(written_bytes == sizeof(header) + sizeof(payload) + sizeof(trailer));
+
+  read_bytes = RS232_Readv(dst, rx_iov, 3, flags, timeout_msec);
+  my_assert(read_bytes == written_bytes);
+
+  my_assert(memcmp(header, rx_header, sizeof(header)) == 0);
+  my_assert(memcmp(payload, rx_payload, sizeof(payload)) == 0);
+  my_assert(memcmp(trailer, rx_trailer, sizeof(trailer)) == 0);
+}
+
+static int test_txqueue_release;
+
+static void test_txqueue_callback(ssize_t written_bytes, void *userdata)
+{
+
+  *(ssize_t *)userdata = written_bytes;
+
+  /* Bytes count as pending until the callback returns, hold them until the test is done. */
+  while (!__atomic_load_n(&test_txqueue_release, __ATOMIC_ACQUIRE))
+  {
+    msleep(1);
+  }
+}
+
+static void test_txqueue(RS232_FD src, RS232_FD dst)
+{
+
+  int flags = 0, timeout_msec = 1000, err;
+  ssize_t read_bytes, result = 0;
+  uint8_t tx_buf[256], rx_buf[256], large_buf[sizeof(tx_buf) + 1] = { 0 };
+
+  for (size_t i = 0; i < sizeof(tx_buf); i++)
+  {
+    tx_buf[i] = i;
+  }
+
+  err = RS232_flushRXTX(src);
+  my_assert(err == 0);
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+
+  RS232_TxQueue *q = RS232_TxQueueCreate(src, sizeof(tx_buf), timeout_msec);
+  my_assert(q != NULL);
+
+  /* More than max_bytes is an error, not back-pressure: it wouldn't fit into an empty queue either. */
+  err = RS232_TxQueueSend(q, large_buf, sizeof(large_buf), NULL, NULL);
+  my_assert(err == -1 && errno == EMSGSIZE);
+
+  err = RS232_TxQueueSend(q, tx_buf, sizeof(tx_buf), test_txqueue_callback, &result);
+  my_assert(err == 0);
+
+  /* Back-pressure: the queue is filled up to max_bytes, not a single byte more fits. */
+  my_assert(RS232_TxQueuePending(q) == sizeof(tx_buf));
+
+  err = RS232_TxQueueSend(q, tx_buf, 1, NULL, NULL);
+  my_assert(err == RS232_TXQUEUE_FULL);
+
+  err = RS232_TxQueueSend(q, tx_buf, sizeof(tx_buf), NULL, NULL);
+  my_assert(err == RS232_TXQUEUE_FULL);
+
+  /* Once received, the frame is in the callback held by the test, still counted as pending. */
+  read_bytes = RS232_Read(dst, rx_buf, sizeof(rx_buf), flags, timeout_msec);
+  my_assert(read_bytes == (ssize_t)sizeof(rx_buf));
+  my_assert(memcmp(tx_buf, rx_buf, sizeof(tx_buf)) == 0);
+
+  /* Urgent data has a budget of its own, a full bulk lane doesn't hold back an emergency stop. */
+  err = RS232_TxQueueSendPrio(q, tx_buf, 8, RS232_TXPRIO_HIGH, NULL, NULL);
+  my_assert(err == 0);
+  my_assert(RS232_TxQueuePending(q) == sizeof(tx_buf) + 8);
+
+  __atomic_store_n(&test_txqueue_release, 1, __ATOMIC_RELEASE);
+
+  err = RS232_TxQueueFlush(q, timeout_msec);
+  my_assert(err == 0);
+  my_assert(result == sizeof(tx_buf));
+
+  RS232_TxQueueDestroy(q);
+
+  read_bytes = RS232_Read(dst, rx_buf, 8, flags, timeout_msec);
+  my_assert(read_bytes == 8);
+  my_assert(memcmp(tx_buf, rx_buf, 8) == 0);
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+}
+
+typedef struct
+{
+  int order[8];
+  int count;
+} test_txqueue_prio_result;
+
+static test_txqueue_prio_result prio_result;
+
+static void test_txqueue_prio_callback(ssize_t written_bytes, void *userdata)
+{
+
+  my_assert(written_bytes > 0);
+  prio_result.order[prio_result.count] = (int)(intptr_t)userdata;
+  __atomic_add_fetch(&prio_result.count, 1, __ATOMIC_RELEASE);
+
+  /* Hold the writer after the first frame until everything has been queued. */
+  while (!__atomic_load_n(&test_txqueue_release, __ATOMIC_ACQUIRE))
+  {
+    msleep(1);
+  }
+}
+
+static void test_txqueue_prio(RS232_FD src, RS232_FD dst)
+{
+
+  int flags = 0, timeout_msec = 1000, err;
+  ssize_t read_bytes;
+  uint8_t bulk[64] = { 0 }, urgent[4] = { 0xff, 0xff, 0xff, 0xff }, rx_buf[4 * sizeof(bulk) + 2 * sizeof(urgent)];
+  const int expected[] = { 0, 4, 5, 1, 2, 3 };
+
+  err = RS232_flushRXTX(src);
+  my_assert(err == 0);
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+
+  RS232_TxQueue *q = RS232_TxQueueCreate(src, sizeof(rx_buf), timeout_msec);
+  my_assert(q != NULL);
+
+  err = RS232_TxQueueSetOutqLimit(q, 16);
+  my_assert(err == 0);
+
+  memset(&prio_result, 0, sizeof(prio_result));
+  __atomic_store_n(&test_txqueue_release, 0, __ATOMIC_RELEASE);
+
+  for (intptr_t i = 0; i < 4; i++)
+  {
+    err = RS232_TxQueueSendPrio(q, bulk, sizeof(bulk), RS232_TXPRIO_BULK, test_txqueue_prio_callback, (void *)i);
+    my_assert(err == 0);
+  }
+
+  /* Wait for the writer to be done with the first frame, the other ones are queued then. */
+  while (__atomic_load_n(&prio_result.count, __ATOMIC_ACQUIRE) == 0)
+  {
+    msleep(1);
+  }
+
+  for (intptr_t i = 4; i < 6; i++)
+  {
+    err = RS232_TxQueueSendPrio(q, urgent, sizeof(urgent), RS232_TXPRIO_HIGH, test_txqueue_prio_callback, (void *)i);
+    my_assert(err == 0);
+  }
+
+  __atomic_store_n(&test_txqueue_release, 1, __ATOMIC_RELEASE);
+
+  err = RS232_TxQueueFlush(q, 2 * timeout_msec);
+  my_assert(err == 0);
+  my_assert(prio_result.count == 6);
+
+  /* The urgent frames overtake the bulk frames still queued, each lane stays in order. */
+  for (int i = 0; i < 6; i++)
+  {
+    my_assert(prio_result.order[i] == expected[i]);
+  }
+
+  RS232_TxQueueDestroy(q);
+
+  read_bytes = RS232_Read(dst, rx_buf, sizeof(rx_buf), flags, timeout_msec);
+  my_assert(read_bytes == (ssize_t)sizeof(rx_buf));
+
+  for (size_t i = 0; i < sizeof(rx_buf); i++)
+  {
+    bool is_urgent = (i >= sizeof(bulk) && i < sizeof(bulk) + 2 * sizeof(urgent));
+    my_assert(rx_buf[i] == (is_urgent ? 0xff : 0x00));
+  }
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+}
+
+static void test_uring(RS232_FD src, RS232_FD dst)
+{
+
+  int timeout_msec = 1000, err, count, done = 0;
+  uint8_t tx_buf[32], rx_buf[32];
+  RS232_IOVec iov = { rx_buf, sizeof(rx_buf) };
+  RS232_UringCompletion completions[2];
+
+  for (size_t i = 0; i < sizeof(tx_buf); i++)
+  {
+    tx_buf[i] = i;
+  }
+
+  RS232_Uring *uring = RS232_UringCreate(2);
+  if (uring == NULL)
+  {
+    printf("io_uring not available, skipped.\n");
+    return;
+  }
+
+  err = RS232_flushRXTX(src);
+  my_assert(err == 0);
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+
+  err = RS232_UringRegisterBuffers(uring, &iov, 1);
+  my_assert(err == 0);
+
+  err = RS232_UringPrepRead(uring, dst, rx_buf, sizeof(rx_buf), 0, timeout_msec, rx_buf);
+  my_assert(err == 0);
+
+  err = RS232_UringPrepWrite(uring, src, tx_buf, sizeof(tx_buf), -1, timeout_msec, tx_buf);
+  my_assert(err == 0);
+
+  /* Both requests go to the kernel with a single system call. */
+  while (done < 2)
+  {
+    count = RS232_UringSubmit(uring, completions, 2, timeout_msec);
+    my_assert(count > 0);
+
+    for (int i = 0; i < count; i++)
+    {
+      my_assert(completions[i].result > 0);
+      if (completions[i].userdata == tx_buf) my_assert(completions[i].result == (ssize_t)sizeof(tx_buf));
+    }
+
+    done += count;
+  }
+
+  /* A read is allowed to return before all the data has arrived. */
+  my_assert(memcmp(tx_buf, rx_buf, 1) == 0);
+
+  /* Nothing sent: the linked timeout cancels the read. */
+  err = RS232_UringPrepRead(uring, dst, rx_buf, sizeof(rx_buf), 0, 10, NULL);
+  my_assert(err == 0);
+
+  RS232_flushRX(dst);
+
+  count = RS232_UringSubmit(uring, completions, 2, timeout_msec);
+  my_assert(count == 1);
+  my_assert(completions[0].result == 0);
+
+  RS232_UringDestroy(uring);
+}
+
+static void test_poller(RS232_FD src, RS232_FD dst)
+{
+
+  int flags = 0, timeout_msec = 1000, err, count;
+  ssize_t written_bytes;
+  uint8_t tx_buf[16] = { 0 };
+  RS232_PollEvent events[2];
+  int tag_src = 1, tag_dst = 2;
+
+  err = RS232_flushRXTX(src);
+  my_assert(err == 0);
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+
+  RS232_Poller *poller = RS232_PollerCreate();
+  my_assert(poller != NULL);
+
+  err = RS232_PollerAdd(poller, src, RS232_POLL_IN, &tag_src);
+  my_assert(err == 0);
+
+  err = RS232_PollerAdd(poller, dst, RS232_POLL_IN, &tag_dst);
+  my_assert(err == 0);
+
+  count = RS232_PollerWait(poller, events, 2, 10);
+  my_assert(count == 0);
+
+  written_bytes = RS232_Write(src, tx_buf, sizeof(tx_buf), flags, timeout_msec);
+  my_assert(written_bytes == sizeof(tx_buf));
+
+  count = RS232_PollerWait(poller, events, 2, timeout_msec);
+  my_assert(count == 1);
+  my_assert(events[0].fd == dst);
+  my_assert(events[0].events & RS232_POLL_IN);
+  my_assert(events[0].userdata == &tag_dst);
+
+  err = RS232_PollerRemove(poller, src);
+  my_assert(err == 0);
+
+  err = RS232_PollerRemove(poller, dst);
+  my_assert(err == 0);
+
+  RS232_PollerDestroy(poller);
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+}
+
+static void test_cts_rts(const char *argv_1, const char *argv_2, int baudrate, const char *mode)
+{
+
+  int err, status;
+
+  RS232_FD src = try_RS232_Open(argv_1, baudrate, mode, 0);
+  my_assert(src != RS232_INVALID_FD);
+
+  RS232_FD dst = try_RS232_Open(argv_2, baudrate, mode, 0);
+  my_assert(dst != RS232_INVALID_FD);
+
+  status = RS232_IsCTSEnabled(src);
+  my_assert(status == 1);
+  status = RS232_IsCTSEnabled(dst);
+  my_assert(status == 1);
+
+  err = RS232_disableRTS(src);
+  my_assert(err == 0);
+  err = RS232_disableRTS(dst);
+  my_assert(err == 0);
+
+  /* Give OS some time to switch lines. */
+  msleep(100);
+
+  status = RS232_IsCTSEnabled(src);
+  my_assert(status == 0);
+  status = RS232_IsCTSEnabled(dst);
+  my_assert(status == 0);
+
+  err = RS232_enableRTS(src);
+  my_assert(err == 0);
+  err = RS232_enableRTS(dst);
+  my_assert(err == 0);
+
+  /* Give OS some time to switch lines. */
+  msleep(100);
+
+  status = RS232_IsCTSEnabled(src);
+  my_assert(status == 1);
+  status = RS232_IsCTSEnabled(dst);
+  my_assert(status == 1);
+
+  err = RS232_Close(src);
+  my_assert(err == 0);
+
+  err = RS232_Close(dst);
+  my_assert(err == 0);
+}
+
+static void test_dtr_dsr(const char *argv_1, const char *argv_2, int baudrate, const char *mode)
+{
+
+  int err, status;
+
+  RS232_FD src = try_RS232_Open(argv_1, baudrate, mode, 0);
+  my_assert(src != RS232_INVALID_FD);
+
+  RS232_FD dst = try_RS232_Open(argv_2, baudrate, mode, 0);
+  my_assert(dst != RS232_INVALID_FD);
+
+  status = RS232_IsCTSEnabled(src);
+  my_assert(status == 1);
+  status = RS232_IsCTSEnabled(dst);
+  my_assert(status == 1);
+
+  err = RS232_disableDTR(src);
+  my_assert(err == 0);
+  err = RS232_disableDTR(dst);
+  my_assert(err == 0);
+
+  /* Give OS some time to switch lines. */
+  msleep(100);
+
+  status = RS232_IsDSREnabled(src);
+  my_assert(status == 0);
+  status = RS232_IsDSREnabled(dst);
+  my_assert(status == 0);
+
+  err = RS232_enableDTR(src);
+  my_assert(err == 0);
+  err = RS232_enableDTR(dst);
+  my_assert(err == 0);
+
+  /* Give OS some time to switch lines. */
+  msleep(100);
+
+  status = RS232_IsDSREnabled(src);
+  my_assert(status == 1);
+  status = RS232_IsDSREnabled(dst);
+  my_assert(status == 1);
+
+  err = RS232_Close(src);
+  my_assert(err == 0);
+
+  err = RS232_Close(dst);
+  my_assert(err == 0);
+}
+
+static void test_break(RS232_FD src, RS232_FD dst)
+{
+
+  int err;
+  int flags = 0, timeout_msec = 1;
+  ssize_t read_bytes;
+  uint8_t rx_buf[256];
+
+  for (size_t i = 0; i < sizeof(rx_buf); i++)
+  {
+    rx_buf[i] = 0xF0;
+  }
+
+  err = RS232_disableBREAK(src);
+  my_assert(err == 0);
+
+  err = RS232_disableBREAK(dst);
+  my_assert(err == 0);
+
+  err = RS232_flushRXTX(src);
+  my_assert(err == 0);
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+
+  int zeros = 0;
+
+  /* Send break characters. */
+  for (size_t i = 0; i < 1000; i++)
+  {
+    err = RS232_enableBREAK(src);
+    my_assert(err == 0);
+
+    read_bytes = RS232_Read(dst, rx_buf, sizeof(rx_buf), flags, timeout_msec);
+    for (ssize_t k = 0; k < read_bytes; k++)
+    {
+      if (rx_buf[k] == 0) ++zeros;
+    }
+
+    err = RS232_disableBREAK(src);
+    my_assert(err == 0);
+
+    if (zeros >= 100) break;
+  }
+  my_assert(zeros >= 100);
+
+  err = RS232_flushRXTX(src);
+  my_assert(err == 0);
+
+  err = RS232_flushRXTX(dst);
+  my_assert(err == 0);
+
+  read_bytes = RS232_Read(dst, rx_buf, sizeof(rx_buf), flags, timeout_msec);
+  my_assert(read_bytes == 0);
+}
+
+static void test_port(const char *argv_1, const char *argv_2, int baudrate, const char *mode)
+{
+
+  int flags = 0, timeout_msec = 1000, err;
+  ssize_t written_bytes, read_bytes;
+  uint8_t tx_buf[64], rx_buf[64];
+
+  for (size_t i = 0; i < sizeof(tx_buf); i++)
+  {
+    tx_buf[i] = i;
+  }
+
+  RS232_Port *src = RS232_PortOpen(argv_1, baudrate, mode, 0, NULL);
+  my_assert(src != NULL);
+
+  RS232_Port *dst = RS232_PortOpen(argv_2, baudrate, mode, 0, NULL);
+  my_assert(dst != NULL);
+
+  my_assert(RS232_PortGetBaudrate(src) == baudrate);
+  my_assert(RS232_PortRxBuffer(dst) == NULL);
+
+  err = RS232_PortSetRxBuffer(dst, 256);
+  my_assert(err == 0);
+  my_assert(RS232_PortRxBuffer(dst) != NULL);
+
+  err = RS232_PortEnableStats(src, 1);
+  my_assert(err == 0);
+
+  err = RS232_PortEnableStats(dst, 1);
+  my_assert(err == 0);
+
+  written_bytes = RS232_PortWrite(src, tx_buf, sizeof(tx_buf), flags, timeout_msec);
+  my_assert(written_bytes == (ssize_t)sizeof(tx_buf));
+
+  read_bytes = RS232_PortRead(dst, rx_buf, sizeof(rx_buf), flags, timeout_msec);
+  my_assert(read_bytes == (ssize_t)sizeof(rx_buf));
+  my_assert(memcmp(tx_buf, rx_buf, sizeof(tx_buf)) == 0);
+
+#if WITH_RS232_STATS
+  RS232_Stats stats;
+
+  err = RS232_PortGetStats(src, &stats);
+  my_assert(err == 0);
+  my_assert(stats.write_bytes == sizeof(tx_buf));
+  my_assert(stats.write_calls >= 1 && stats.write_errors == 0);
+#if WINDOWS_BUILD == 0
+  my_assert(stats.write_polls == stats.write_calls);
+  my_assert(stats.write_syscalls == stats.write_polls + stats.write_calls - stats.write_timeouts);
+#endif
+
+  err = RS232_PortGetStats(dst, &stats);
+  my_assert(err == 0);
+  my_assert(stats.read_bytes >= sizeof(rx_buf));
+  my_assert(stats.read_calls >= 1 && stats.read_errors == 0);
+#if WINDOWS_BUILD == 0
+  my_assert(stats.read_polls == stats.read_calls);
+  my_assert(stats.read_syscalls == stats.read_polls + stats.read_calls - stats.read_timeouts);
+#endif
+
+  uint64_t reads = 0;
+  for (int i = 0; i < RS232_STATS_BUCKETS; i++)
+  {
+    reads += stats.read_latency_hist[i];
+  }
+  my_assert(reads == stats.read_calls);
+
+  RS232_PortResetStats(dst);
+  err = RS232_PortGetStats(dst, &stats);
+  my_assert(err == 0);
+  my_assert(stats.read_calls == 0 && stats.read_bytes == 0);
+#endif
+
+  err = RS232_PortReconfigure(src, 57600, mode, 0);
+  my_assert(err == 0);
+  my_assert(RS232_PortGetBaudrate(src) == 57600);
+
+  err = RS232_PortClose(src);
+  my_assert(err == 0);
+
+  err = RS232_PortClose(dst);
+  my_assert(err == 0);
+}
+
+static void test_modbus_crc(void)
+{
+
+  uint8_t adu[] = { 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A, 0x00, 0x00 };
+
+  my_assert(RS232_ModbusCRC16("123456789", 9) == 0x4B37);
+
+  /* Read holding registers request, CRC is sent low byte first: C5 CD. */
+  uint16_t crc = RS232_ModbusCRC16(adu, 6);
+  my_assert((crc & 0xFF) == 0xC5 && (crc >> 8) == 0xCD);
+
+  adu[6] = crc & 0xFF;
+  adu[7] = crc >> 8;
+  my_assert(RS232_ModbusCRC16(adu, sizeof(adu)) == 0);
+}
+
+static void test_modbus(const char *argv_1, const char *argv_2, int baudrate, const char *mode)
+{
+
+  int timeout_msec = 1000, err;
+  ssize_t len;
+  uint8_t request[] = { 0x11, 0x03, 0x00, 0x6B, 0x00, 0x03 };
+  uint8_t adu[RS232_MODBUS_MAX_ADU];
+  long t15_usec, t35_usec;
+  RS232_ModbusStats stats;
 
-  RS232_FD fd = RS232_Open(devname, baudrate, mode, flags);
+  RS232_Port *src = RS232_PortOpen(argv_1, baudrate, mode, 0, NULL);
+  my_assert(src != NULL);
 
-  while (fd == RS232_INVALID_FD && attempts--)
+  RS232_Port *dst = RS232_PortOpen(argv_2, baudrate, mode, 0, NULL);
+  my_assert(dst != NULL);
+
+  RS232_Modbus *master = RS232_ModbusCreate(src, 0);
+  my_assert(master != NULL);
+
+  RS232_Modbus *slave = RS232_ModbusCreate(dst, RS232_MODBUS_STRICT);
+  my_assert(slave != NULL);
+
+  RS232_ModbusGetGaps(master, &t15_usec, &t35_usec);
+  my_assert(t15_usec == 750 && t35_usec == 1750);
+
+  for (int i = 0; i < 3; i++)
   {
-    msleep(1000);
-    fd = RS232_Open(devname, baudrate, mode, flags);
+    len = RS232_ModbusSend(master, request, sizeof(request), timeout_msec);
+    my_assert(len == (ssize_t)sizeof(request));
+
+    len = RS232_ModbusReceive(slave, adu, sizeof(adu), timeout_msec);
+    my_assert(len == (ssize_t)sizeof(request));
+    my_assert(memcmp(adu, request, sizeof(request)) == 0);
   }
 
-  return fd;
+  len = RS232_ModbusReceive(slave, adu, sizeof(adu), 100);
+  my_assert(len == 0);
+
+  RS232_ModbusGetStats(slave, &stats);
+  my_assert(stats.frames == 3 && stats.crc_errors == 0 && stats.dropped == 0);
+
+  RS232_ModbusDestroy(master);
+  RS232_ModbusDestroy(slave);
+
+  err = RS232_PortClose(src);
+  my_assert(err == 0);
+
+  err = RS232_PortClose(dst);
+  my_assert(err == 0);
 }
 
-static void test_write_read_256bytes(RS232_FD src, RS232_FD dst)
+static int test_modbus_scheduler_timeouts;
+
+static void test_modbus_scheduler_callback(const RS232_ModbusJob *job, int status, const uint8_t *data, size_t size)
 {
 
-  int flags = 0, timeout_msec = 1000, err;
-  ssize_t written_bytes, read_bytes;
-  uint8_t tx_buf[256], rx_buf[256];
+  (void)job;
+  my_assert(status == RS232_MODBUS_TIMEOUT && data == NULL && size == 0);
+  test_modbus_scheduler_timeouts++;
+}
 
-  for (size_t i = 0; i < sizeof(tx_buf); i++)
-  {
-    tx_buf[i] = i;
-    rx_buf[i] = 0;
-  }
+static void test_modbus_scheduler(const char *argv_1, const char *argv_2, int baudrate, const char *mode)
+{
 
-  err = RS232_flushRXTX(src);
+  int err;
+  ssize_t len;
+  uint8_t adu[RS232_MODBUS_MAX_ADU];
+
+  RS232_Port *src = RS232_PortOpen(argv_1, baudrate, mode, 0, NULL);
+  my_assert(src != NULL);
+
+  RS232_Port *dst = RS232_PortOpen(argv_2, baudrate, mode, 0, NULL);
+  my_assert(dst != NULL);
+
+  RS232_Modbus *master = RS232_ModbusCreate(src, 0);
+  my_assert(master != NULL);
+
+  RS232_Modbus *slave = RS232_ModbusCreate(dst, 0);
+  my_assert(slave != NULL);
+
+  /* Three adjacent or overlapping register ranges make one request, nobody answers it. */
+  RS232_ModbusJob jobs[] = {
+    { master, 17, 3, 110, 5,  1000, 50, NULL },
+    { master, 17, 3, 100, 10, 1000, 50, NULL },
+    { master, 17, 3, 105, 20, 1000, 50, NULL },
+  };
+
+  RS232_ModbusScheduler *sched = RS232_ModbusSchedulerCreate(jobs, sizeof(jobs) / sizeof(jobs[0]), test_modbus_scheduler_callback);
+  my_assert(sched != NULL);
+
+  err = RS232_ModbusSchedulerRun(sched, 200);
   my_assert(err == 0);
+  my_assert(test_modbus_scheduler_timeouts == 3);
 
-  err = RS232_flushRXTX(dst);
+  len = RS232_ModbusReceive(slave, adu, sizeof(adu), 100);
+  my_assert(len == 6);
+  my_assert(adu[0] == 17 && adu[1] == 3);
+  my_assert(((adu[2] << 8) | adu[3]) == 100 && ((adu[4] << 8) | adu[5]) == 25);
+
+  len = RS232_ModbusReceive(slave, adu, sizeof(adu), 100);
+  my_assert(len == 0);
+
+  RS232_ModbusSchedulerDestroy(sched);
+  RS232_ModbusDestroy(master);
+  RS232_ModbusDestroy(slave);
+
+  err = RS232_PortClose(src);
   my_assert(err == 0);
 
-  written_bytes = RS232_Write(src, tx_buf, sizeof(tx_buf), flags, timeout_msec);
-  my_assert(written_bytes == sizeof(tx_buf));
+  err = RS232_PortClose(dst);
+  my_assert(err == 0);
+}
 
-  read_bytes = RS232_Read(dst, rx_buf, sizeof(rx_buf), flags, timeout_msec);
-  my_assert(read_bytes == (ssize_t)sizeof(rx_buf));
+static int test_modbus_scheduler_replies;
 
-  for (ssize_t i = 0; i < read_bytes; i++)
+/* Register n holds the value n, coil n is on if n is a multiple of 3. */
+static void test_modbus_scheduler_reply_callback(const RS232_ModbusJob *job, int status, const uint8_t *data, size_t size)
+{
+
+  my_assert(status == 0 && data != NULL);
+
+  if (job->function == 3)
   {
-    my_assert(tx_buf[i] == rx_buf[i]);
+    my_assert(size == (size_t)job->count * 2);
+    for (unsigned i = 0; i < job->count; i++)
+    {
+      my_assert((unsigned)((data[2 * i] << 8) | data[2 * i + 1]) == job->address + i);
+    }
+  }
+  else
+  {
+    my_assert(size == ((size_t)job->count + 7) / 8);
+    for (unsigned i = 0; i < job->count; i++)
+    {
+      my_assert(!!(data[i / 8] & (1 << (i % 8))) == ((job->address + i) % 3 == 0));
+    }
   }
+
+  test_modbus_scheduler_replies++;
 }
 
-static void test_write_read_256bytes_nonblocking(RS232_FD src, RS232_FD dst)
+static void test_modbus_scheduler_reply(const char *argv_1, const char *argv_2, int baudrate, const char *mode)
 {
 
-  int flags = 0, timeout_msec = 0, err;
-  ssize_t written_bytes, read_bytes;
-  uint8_t tx_buf[256], rx_buf[256];
+  int timeout_msec = 100, err;
+  ssize_t len;
+  uint8_t adu[RS232_MODBUS_MAX_ADU];
 
-  for (size_t i = 0; i < sizeof(tx_buf); i++)
-  {
-    tx_buf[i] = i;
-    rx_buf[i] = 0;
-  }
+  RS232_Port *src = RS232_PortOpen(argv_1, baudrate, mode, 0, NULL);
+  my_assert(src != NULL);
 
-  err = RS232_flushRXTX(src);
+  RS232_Port *dst = RS232_PortOpen(argv_2, baudrate, mode, 0, NULL);
+  my_assert(dst != NULL);
+
+  RS232_Modbus *master = RS232_ModbusCreate(src, 0);
+  my_assert(master != NULL);
+
+  RS232_Modbus *slave = RS232_ModbusCreate(dst, 0);
+  my_assert(slave != NULL);
+
+  /* Registers 100 to 124 and coils 3 to 15 are read with one request each. */
+  RS232_ModbusJob jobs[] = {
+    { master, 17, 3, 110, 5,  1000, 500, NULL },
+    { master, 17, 3, 100, 10, 1000, 500, NULL },
+    { master, 17, 3, 105, 20, 1000, 500, NULL },
+    { master, 17, 1, 3,   5,  1000, 500, NULL },
+    { master, 17, 1, 8,   8,  1000, 500, NULL },
+  };
+
+  RS232_ModbusScheduler *sched = RS232_ModbusSchedulerCreate(jobs, sizeof(jobs) / sizeof(jobs[0]), test_modbus_scheduler_reply_callback);
+  my_assert(sched != NULL);
+
+  /* Coils come first, the jobs are ordered by function. */
+  err = RS232_ModbusSchedulerRun(sched, 50);
   my_assert(err == 0);
 
-  err = RS232_flushRXTX(dst);
+  len = RS232_ModbusReceive(slave, adu, sizeof(adu), timeout_msec);
+  my_assert(len == 6);
+  my_assert(adu[0] == 17 && adu[1] == 1);
+  my_assert(((adu[2] << 8) | adu[3]) == 3 && ((adu[4] << 8) | adu[5]) == 13);
+
+  const uint8_t coils[] = { 17, 1, 2, 0x49, 0x12 };
+  len = RS232_ModbusSend(slave, coils, sizeof(coils), timeout_msec);
+  my_assert(len == (ssize_t)sizeof(coils));
+
+  err = RS232_ModbusSchedulerRun(sched, 50);
   my_assert(err == 0);
+  my_assert(test_modbus_scheduler_replies == 2);
 
-  written_bytes = RS232_Write(src, tx_buf, sizeof(tx_buf), flags, timeout_msec);
-  my_assert(written_bytes == sizeof(tx_buf));
+  len = RS232_ModbusReceive(slave, adu, sizeof(adu), timeout_msec);
+  my_assert(len == 6);
+  my_assert(adu[0] == 17 && adu[1] == 3);
+  my_assert(((adu[2] << 8) | adu[3]) == 100 && ((adu[4] << 8) | adu[5]) == 25);
 
-  read_bytes = RS232_Read(dst, rx_buf, sizeof(rx_buf), flags, timeout_msec);
-  my_assert(read_bytes <= (ssize_t)sizeof(rx_buf) && read_bytes >= 0);
+  /* A frame of the slave for another function is not the response, the request stays pending. */
+  const uint8_t other[] = { 17, 4, 2, 0xDE, 0xAD };
+  len = RS232_ModbusSend(slave, other, sizeof(other), timeout_msec);
+  my_assert(len == (ssize_t)sizeof(other));
 
-  for (ssize_t i = 0; i < read_bytes; i++)
+  /* Received separately, frames read at once from the driver would run into each other. */
+  err = RS232_ModbusSchedulerRun(sched, 50);
+  my_assert(err == 0);
+  my_assert(test_modbus_scheduler_replies == 2);
+
+  uint8_t registers[3 + 25 * 2] = { 17, 3, 25 * 2 };
+  for (int i = 0; i < 25; i++)
   {
-    my_assert(tx_buf[i] == rx_buf[i]);
+    registers[3 + 2 * i] = (uint8_t)((100 + i) >> 8);
+    registers[3 + 2 * i + 1] = (uint8_t)(100 + i);
   }
+
+  len = RS232_ModbusSend(slave, registers, sizeof(registers), timeout_msec);
+  my_assert(len == (ssize_t)sizeof(registers));
+
+  err = RS232_ModbusSchedulerRun(sched, 50);
+  my_assert(err == 0);
+  my_assert(test_modbus_scheduler_replies == 5);
+
+  RS232_ModbusSchedulerDestroy(sched);
+  RS232_ModbusDestroy(master);
+  RS232_ModbusDestroy(slave);
+
+  err = RS232_PortClose(src);
+  my_assert(err == 0);
+
+  err = RS232_PortClose(dst);
+  my_assert(err == 0);
 }
 
-static void test_cts_rts(const char *argv_1, const char *argv_2, int baudrate, const char *mode)
+static void test_modem_lines(const char *argv_1, const char *argv_2, int baudrate, const char *mode)
 {
 
-  int err, status;
-
-  RS232_FD src = try_RS232_Open(argv_1, baudrate, mode, 0);
-  my_assert(src != RS232_INVALID_FD);
+  int err;
 
-  RS232_FD dst = try_RS232_Open(argv_2, baudrate, mode, 0);
-  my_assert(dst != RS232_INVALID_FD);
+  RS232_Port *src = RS232_PortOpen(argv_1, baudrate, mode, 0, NULL);
+  my_assert(src != NULL);
 
-  status = RS232_IsCTSEnabled(src);
-  my_assert(status == 1);
-  status = RS232_IsCTSEnabled(dst);
-  my_assert(status == 1);
+  RS232_Port *dst = RS232_PortOpen(argv_2, baudrate, mode, 0, NULL);
+  my_assert(dst != NULL);
 
-  err = RS232_disableRTS(src);
+  err = RS232_PortSetModemLines(src, RS232_LINE_DTR | RS232_LINE_RTS, 0);
   my_assert(err == 0);
-  err = RS232_disableRTS(dst);
+  my_assert(RS232_PortGetOutputLines(src) == (RS232_LINE_DTR | RS232_LINE_RTS));
+
+  msleep(100);
+  my_assert((RS232_GetModemLines(RS232_PortFD(dst)) & (RS232_LINE_DSR | RS232_LINE_CTS)) == (RS232_LINE_DSR | RS232_LINE_CTS));
+
+  /* Both lines change with one call. */
+  err = RS232_PortSetModemLines(src, 0, RS232_LINE_DTR | RS232_LINE_RTS);
   my_assert(err == 0);
+  my_assert(RS232_PortGetOutputLines(src) == 0);
 
-  /* Give OS some time to switch lines. */
   msleep(100);
+  my_assert((RS232_GetModemLines(RS232_PortFD(dst)) & (RS232_LINE_DSR | RS232_LINE_CTS)) == 0);
 
-  status = RS232_IsCTSEnabled(src);
-  my_assert(status == 0);
-  status = RS232_IsCTSEnabled(dst);
-  my_assert(status == 0);
+  err = RS232_SetModemLines(RS232_PortFD(dst), RS232_LINE_DTR, RS232_LINE_DTR);
+  my_assert(err == -1);
 
-  err = RS232_enableRTS(src);
+  err = RS232_PortSetModemLines(src, RS232_LINE_DTR | RS232_LINE_RTS, 0);
   my_assert(err == 0);
-  err = RS232_enableRTS(dst);
+
+  err = RS232_PortClose(src);
   my_assert(err == 0);
 
-  /* Give OS some time to switch lines. */
-  msleep(100);
+  err = RS232_PortClose(dst);
+  my_assert(err == 0);
+}
 
-  status = RS232_IsCTSEnabled(src);
-  my_assert(status == 1);
-  status = RS232_IsCTSEnabled(dst);
-  my_assert(status == 1);
+static void test_rs485(const char *argv_1, const char *argv_2, int baudrate, const char *mode)
+{
 
-  err = RS232_Close(src);
+  int flags = 0, timeout_msec = 1000, err;
+  ssize_t written_bytes, read_bytes;
+  uint8_t tx_buf[32] = { 0x55 }, rx_buf[32];
+  RS232_RS485Config config;
+
+  RS232_Port *src = RS232_PortOpen(argv_1, baudrate, mode, 0, NULL);
+  my_assert(src != NULL);
+
+  RS232_Port *dst = RS232_PortOpen(argv_2, baudrate, mode, 0, NULL);
+  my_assert(dst != NULL);
+
+  RS232_RS485ConfigInit(&config);
+  config.delay_after_send_msec = 1;
+
+  err = RS232_PortSetRS485(src, &config);
+  my_assert(err == 0 || err == RS232_RS485_SOFTWARE);
+
+  written_bytes = RS232_PortWrite(src, tx_buf, sizeof(tx_buf), flags, timeout_msec);
+  my_assert(written_bytes == (ssize_t)sizeof(tx_buf));
+
+  read_bytes = RS232_PortRead(dst, rx_buf, sizeof(rx_buf), flags, timeout_msec);
+  my_assert(read_bytes == (ssize_t)sizeof(rx_buf));
+  my_assert(memcmp(tx_buf, rx_buf, sizeof(tx_buf)) == 0);
+
+  /* Back to receive: RTS of src, seen as CTS by dst, is low. */
+  msleep(10);
+  my_assert((RS232_GetModemLines(RS232_PortFD(dst)) & RS232_LINE_CTS) == 0);
+
+  /* The same without waiting, as done by event loops. */
+  written_bytes = RS232_PortWriteAsync(src, tx_buf, sizeof(tx_buf));
+  my_assert(written_bytes == (ssize_t)sizeof(tx_buf));
+
+  while ((err = RS232_PortWriteAsyncEnd(src)) == 0)
+  {
+    msleep(1);
+  }
+  my_assert(err == 1);
+
+  read_bytes = RS232_PortRead(dst, rx_buf, sizeof(rx_buf), flags, timeout_msec);
+  my_assert(read_bytes == (ssize_t)sizeof(rx_buf));
+  my_assert(memcmp(tx_buf, rx_buf, sizeof(tx_buf)) == 0);
+
+  msleep(10);
+  my_assert((RS232_GetModemLines(RS232_PortFD(dst)) & RS232_LINE_CTS) == 0);
+
+  err = RS232_PortSetRS485(src, NULL);
   my_assert(err == 0);
 
-  err = RS232_Close(dst);
+  err = RS232_PortClose(src);
+  my_assert(err == 0);
+
+  err = RS232_PortClose(dst);
   my_assert(err == 0);
 }
 
-static void test_dtr_dsr(const char *argv_1, const char *argv_2, int baudrate, const char *mode)
+#if defined(__linux__)
+static void test_line_watcher_callback(const RS232_LineEvent *event, void *userdata)
 {
 
-  int err, status;
+  if (event->changed & RS232_LINE_DSR) (*(int *)userdata)++;
+}
+
+static void test_line_watcher(const char *argv_1, const char *argv_2, int baudrate, const char *mode)
+{
+
+  int err, transitions = 0;
 
   RS232_FD src = try_RS232_Open(argv_1, baudrate, mode, 0);
   my_assert(src != RS232_INVALID_FD);
@@ -169,36 +1434,29 @@ static void test_dtr_dsr(const char *argv_1, const char *argv_2, int baudrate, c
   RS232_FD dst = try_RS232_Open(argv_2, baudrate, mode, 0);
   my_assert(dst != RS232_INVALID_FD);
 
-  status = RS232_IsCTSEnabled(src);
-  my_assert(status == 1);
-  status = RS232_IsCTSEnabled(dst);
-  my_assert(status == 1);
+  err = RS232_enableDTR(src);
+  my_assert(err == 0);
+
+  msleep(100);
+
+  my_assert(RS232_GetModemLines(dst) & RS232_LINE_DSR);
 
+  RS232_LineWatcher *watcher = RS232_LineWatcherStart(dst, RS232_LINE_DSR, test_line_watcher_callback, &transitions, SIGRTMIN);
+  my_assert(watcher != NULL);
+
+  /* No need to wait for the watcher thread, transitions are counted from the start on. */
   err = RS232_disableDTR(src);
   my_assert(err == 0);
-  err = RS232_disableDTR(dst);
-  my_assert(err == 0);
 
-  /* Give OS some time to switch lines. */
   msleep(100);
 
-  status = RS232_IsDSREnabled(src);
-  my_assert(status == 0);
-  status = RS232_IsDSREnabled(dst);
-  my_assert(status == 0);
-
   err = RS232_enableDTR(src);
   my_assert(err == 0);
-  err = RS232_enableDTR(dst);
-  my_assert(err == 0);
 
-  /* Give OS some time to switch lines. */
   msleep(100);
 
-  status = RS232_IsDSREnabled(src);
-  my_assert(status == 1);
-  status = RS232_IsDSREnabled(dst);
-  my_assert(status == 1);
+  RS232_LineWatcherStop(watcher);
+  my_assert(transitions == 2);
 
   err = RS232_Close(src);
   my_assert(err == 0);
@@ -206,61 +1464,126 @@ static void test_dtr_dsr(const char *argv_1, const char *argv_2, int baudrate, c
   err = RS232_Close(dst);
   my_assert(err == 0);
 }
+#endif
 
-static void test_break(RS232_FD src, RS232_FD dst)
+static void test_icounter_callback(RS232_Port *port, const RS232_ICounter *delta, void *userdata)
 {
 
-  int err;
-  int flags = 0, timeout_msec = 1;
-  ssize_t read_bytes;
-  uint8_t rx_buf[256];
+  (void)port;
+  *(uint32_t *)userdata += delta->tx;
+}
 
-  for (size_t i = 0; i < sizeof(rx_buf); i++)
+static void test_icounter(const char *argv_1, const char *argv_2, int baudrate, const char *mode)
+{
+
+  int flags = 0, timeout_msec = 1000, err;
+  ssize_t written_bytes, read_bytes;
+  uint8_t tx_buf[64] = { 0 }, rx_buf[64];
+  RS232_ICounter delta;
+  uint32_t monitored_tx = 0;
+
+  RS232_Port *src = RS232_PortOpen(argv_1, baudrate, mode, 0, NULL);
+  my_assert(src != NULL);
+
+  RS232_Port *dst = RS232_PortOpen(argv_2, baudrate, mode, 0, NULL);
+  my_assert(dst != NULL);
+
+  if (RS232_GetICounter(RS232_PortFD(src), &delta) != 0)
   {
-    rx_buf[i] = 0xF0;
+    printf("Interrupt counters not supported by the driver, skipped.\n");
+    RS232_PortClose(src);
+    RS232_PortClose(dst);
+    return;
   }
 
-  err = RS232_disableBREAK(src);
+  RS232_ICounterMonitor *monitor = RS232_ICounterMonitorStart(10, test_icounter_callback, &monitored_tx);
+  my_assert(monitor != NULL);
+
+  written_bytes = RS232_PortWrite(src, tx_buf, sizeof(tx_buf), flags, timeout_msec);
+  my_assert(written_bytes == (ssize_t)sizeof(tx_buf));
+
+  read_bytes = RS232_PortRead(dst, rx_buf, sizeof(rx_buf), flags, timeout_msec);
+  my_assert(read_bytes == (ssize_t)sizeof(rx_buf));
+
+  err = RS232_PortGetICounterDelta(src, &delta);
   my_assert(err == 0);
+  my_assert(delta.tx >= sizeof(tx_buf));
 
-  err = RS232_disableBREAK(dst);
+  err = RS232_PortGetICounterDelta(dst, &delta);
   my_assert(err == 0);
+  my_assert(delta.rx >= sizeof(rx_buf));
+  my_assert(delta.frame == 0 && delta.overrun == 0 && delta.parity == 0 && delta.buf_overrun == 0);
 
-  err = RS232_flushRXTX(src);
+  RS232_ICounterMonitorStop(monitor);
+  my_assert(monitored_tx <= sizeof(tx_buf)); /* Only src has sent, and only tx_buf. */
+
+  err = RS232_PortClose(src);
   my_assert(err == 0);
 
-  err = RS232_flushRXTX(dst);
+  err = RS232_PortClose(dst);
   my_assert(err == 0);
+}
 
-  int zeros = 0;
+static void test_open_many(const char *argv_1, const char *argv_2, int baudrate, const char *mode)
+{
 
-  /* Send break characters. */
-  for (size_t i = 0; i < 1000; i++)
+  int err;
+  size_t opened;
+  RS232_OpenOptions options;
+  RS232_OpenSpec specs[4] =
   {
-    err = RS232_enableBREAK(src);
-    my_assert(err == 0);
-
-    read_bytes = RS232_Read(dst, rx_buf, sizeof(rx_buf), flags, timeout_msec);
-    for (ssize_t k = 0; k < read_bytes; k++)
-    {
-      if (rx_buf[k] == 0) ++zeros;
-    }
+    { argv_1, baudrate, mode, 0, RS232_INVALID_FD, 0 },
+    { argv_2, baudrate, mode, 0, RS232_INVALID_FD, 0 },
+    { "/dev/does-not-exist", baudrate, mode, 0, RS232_INVALID_FD, 0 },
+    { "/dev/does-not-exist", baudrate, "8X1", 0, RS232_INVALID_FD, 0 },
+  };
+
+  RS232_OpenOptionsInit(&options);
+  options.max_attempts = 1;
+
+  opened = RS232_OpenMany(specs, 4, 4, &options);
+  my_assert(opened == 2);
+  my_assert(specs[0].fd != RS232_INVALID_FD && specs[0].error == 0);
+  my_assert(specs[1].fd != RS232_INVALID_FD && specs[1].error == 0);
+#if WINDOWS_BUILD == 0
+  my_assert(specs[2].fd == RS232_INVALID_FD && specs[2].error == ENOENT);
+  my_assert(specs[3].fd == RS232_INVALID_FD && specs[3].error == EINVAL);
+#else
+  my_assert(specs[2].fd == RS232_INVALID_FD && specs[2].error != 0);
+  my_assert(specs[3].fd == RS232_INVALID_FD && specs[3].error == ERROR_INVALID_PARAMETER);
+#endif
 
-    err = RS232_disableBREAK(src);
-    my_assert(err == 0);
+  test_write_read_256bytes(specs[0].fd, specs[1].fd);
 
-    if (zeros >= 100) break;
-  }
-  my_assert(zeros >= 100);
+  err = RS232_Close(specs[0].fd);
+  my_assert(err == 0);
 
-  err = RS232_flushRXTX(src);
+  err = RS232_Close(specs[1].fd);
   my_assert(err == 0);
+}
 
-  err = RS232_flushRXTX(dst);
+static void test_custom_baudrate(const char *argv_1, const char *argv_2, int baudrate, const char *mode)
+{
+
+  int err, actual;
+
+  RS232_FD src = try_RS232_Open(argv_1, baudrate, mode, 0);
+  my_assert(src != RS232_INVALID_FD);
+
+  RS232_FD dst = try_RS232_Open(argv_2, baudrate, mode, 0);
+  my_assert(dst != RS232_INVALID_FD);
+
+  /* Allow 3% deviation between the requested and the achieved baudrate. */
+  actual = RS232_GetBaudrate(src);
+  my_assert(actual > baudrate - baudrate / 33 && actual < baudrate + baudrate / 33);
+
+  test_write_read_256bytes(src, dst);
+
+  err = RS232_Close(src);
   my_assert(err == 0);
 
-  read_bytes = RS232_Read(dst, rx_buf, sizeof(rx_buf), flags, timeout_msec);
-  my_assert(read_bytes == 0);
+  err = RS232_Close(dst);
+  my_assert(err == 0);
 }
 
 static void test_hwflowcontrol(const char *argv_1, const char *argv_2, int baudrate, const char *mode)
@@ -351,6 +1674,13 @@ int main(int argc, char *argv[])
   }
 
   int err, status;
+
+#if WINDOWS_BUILD == 0
+  test_open_fail_fast();
+#endif
+  test_modbus_crc();
+  test_codec();
+
   RS232_FD src = RS232_Open(argv[1], 115200, "8N1", 0);
   my_assert(src != RS232_INVALID_FD);
 
@@ -365,7 +1695,20 @@ int main(int argc, char *argv[])
 
   test_write_read_256bytes(src, dst);
   test_write_read_256bytes_nonblocking(src, dst);
+  test_write_read_some(src, dst);
+  test_read_until_deadline(src, dst);
+  test_drain(src, dst);
+  test_kernel_timeout(src, dst);
+  test_reconfigure(src, dst);
+  test_rx_buffer(src, dst);
+  test_read_frame(src, dst);
+  test_codec_read_write(src, dst);
+  test_writev_readv(src, dst);
+  test_txqueue(src, dst);
+  test_txqueue_prio(src, dst);
   test_break(src, dst);
+  test_poller(src, dst);
+  test_uring(src, dst);
 
   err = RS232_Close(src);
   my_assert(err == 0);
@@ -387,6 +1730,20 @@ int main(int argc, char *argv[])
   test_hwflowcontrol(argv[1], argv[2], 115200, "8E1");
   test_hwflowcontrol(argv[1], argv[2], 115200, "8O1");
   test_hwflowcontrol(argv[1], argv[2], 115200, "8N1");
+  test_port(argv[1], argv[2], 115200, "8N1");
+  test_icounter(argv[1], argv[2], 115200, "8N1");
+  test_modem_lines(argv[1], argv[2], 115200, "8N1");
+  test_rs485(argv[1], argv[2], 115200, "8N1");
+  test_modbus(argv[1], argv[2], 115200, "8N1");
+#if WINDOWS_BUILD == 0
+  test_modbus_scheduler(argv[1], argv[2], 115200, "8N1");
+  test_modbus_scheduler_reply(argv[1], argv[2], 115200, "8N1");
+  test_open_many(argv[1], argv[2], 115200, "8N1");
+#endif
+#if defined(__linux__)
+  test_line_watcher(argv[1], argv[2], 115200, "8N1");
+  test_custom_baudrate(argv[1], argv[2], 250000, "8N1");
+#endif
   //test_hwflowcontrol2(argv[1], argv[2],   300, "8N1");
 
   fprintf(stdout, "All tests passed!\n");